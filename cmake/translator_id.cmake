@@ -0,0 +1,11 @@
+# Записывает в OUTPUT идентификатор транслятора - SHA-1 от содержимого файлов SOURCES.
+# Кеш трансляции (cache.cpp) действителен только для транслятора с тем же идентификатором
+set(hashes "")
+
+foreach(source ${SOURCES})
+	file(SHA1 ${source} hash)
+	set(hashes "${hashes}${hash}")
+endforeach()
+
+string(SHA1 id "${hashes}")
+file(WRITE ${OUTPUT} "#define INT6502_TRANSLATOR_ID \"${id}\"\n")
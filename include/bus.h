@@ -0,0 +1,125 @@
+#ifndef INT6502_BUS_H
+#define INT6502_BUS_H
+
+#include "insn.h"
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Шина памяти. Адресное пространство разбито на 256 страниц: страница либо
+	// целиком обычная память (чтение и запись без вызовов), либо в ней есть байты,
+	// отображённые на устройства. Обращение к такому байту вызывает обработчик устройства,
+	// а обращения к остальным байтам страницы идут напрямую в память.
+	// Стек, указатели косвенной адресации и код читаются напрямую, минуя устройства.
+	class Bus {
+	public:
+		// Устройство, отображённое на диапазон адресов. mem - память машины:
+		// устройство может хранить в ней своё значение, чтобы оно было видно в дампе
+		class Device {
+		public:
+			virtual ~Device() {}
+			
+			virtual uint8_t read(uint8_t* mem, uint16_t addr) {
+				return mem[addr];
+			}
+			
+			virtual void write(uint8_t* mem, uint16_t addr, uint8_t value) {
+				mem[addr] = value;
+			}
+		};
+		
+		// Какие обращения перехватывает устройство
+		static const unsigned
+				READ  = 0x1,
+				WRITE = 0x2;
+		
+		static const size_t PAGES = MEM_SIZE >> 8;
+		
+		// Номер отображения + 1 для каждого байта страницы, 0 - обычная память
+		struct Page {
+			uint8_t mappings[0x100];
+		};
+	
+	private:
+		struct Mapping {
+			Device* device;
+			uint16_t first, last;
+			unsigned access;
+		};
+		
+		uint8_t* const mem;
+		std::vector<Mapping> mappings;
+		
+		// NULL - страница целиком обычная память
+		Page* readPages[PAGES];
+		Page* writePages[PAGES];
+		std::vector<std::unique_ptr<Page>> pages;
+		
+		void rebuild();
+	
+	public:
+		// mem должна существовать, пока существует шина
+		explicit Bus(uint8_t* mem);
+		
+		Bus(const Bus&) = delete;
+		
+		// Отображает на устройство адреса first-last включительно. access - READ и/или WRITE.
+		// Если диапазоны устройств пересекаются, обращения получает устройство, отображённое позже.
+		// Устройство должно существовать, пока оно отображено. Возвращает 0 в случае успеха, иначе код ошибки.
+		int map(Device* device, uint16_t first, uint16_t last, unsigned access);
+		
+		// Убирает все отображения устройства
+		void unmap(Device* device);
+		
+		inline uint8_t* getMemory() const {
+			return mem;
+		}
+		
+		inline uint8_t read(uint16_t addr) {
+			const Page* page = readPages[addr >> 8];
+			uint8_t index;
+			
+			if (page == nullptr || (index = page->mappings[addr & 0xFF]) == 0) {
+				return mem[addr];
+			}
+			
+			return mappings[index - 1].device->read(mem, addr);
+		}
+		
+		inline void write(uint16_t addr, uint8_t value) {
+			const Page* page = writePages[addr >> 8];
+			uint8_t index;
+			
+			if (page == nullptr || (index = page->mappings[addr & 0xFF]) == 0) {
+				mem[addr] = value;
+				return;
+			}
+			
+			mappings[index - 1].device->write(mem, addr, value);
+		}
+		
+		// Возвращает true, если чтение (запись) по адресу addr обрабатывает устройство
+		inline bool isReadHooked(uint16_t addr) const {
+			const Page* page = readPages[addr >> 8];
+			return page != nullptr && page->mappings[addr & 0xFF] != 0;
+		}
+		
+		inline bool isWriteHooked(uint16_t addr) const {
+			const Page* page = writePages[addr >> 8];
+			return page != nullptr && page->mappings[addr & 0xFF] != 0;
+		}
+		
+		// Таблицы страниц (массивы длины PAGES) для скомпилированного кода
+		inline const Page* const* getReadPages() const {
+			return readPages;
+		}
+		
+		inline const Page* const* getWritePages() const {
+			return writePages;
+		}
+	};
+}
+
+#endif /* INT6502_BUS_H */
@@ -0,0 +1,29 @@
+#ifndef INT6502_CACHE_H
+#define INT6502_CACHE_H
+
+#include "translator.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace int6502 {
+	
+	enum class CacheMode {
+		USE,      // Взять результат из кеша, если исходник не менялся, иначе транслировать и обновить кеш
+		REBUILD,  // Транслировать заново и перезаписать кеш
+		DISABLED, // Не читать и не записывать кеш
+	};
+	
+	
+	// Возвращает путь к кешу исходника filename: рядом с ним, с добавленным расширением ".cache"
+	extern std::string getCachePath(const char* filename);
+	
+	// То же, что и translate(filename, code, &debug), но машинный код, номера строк и лейблы
+	// сохраняются в кеш вместе с хешем содержимого исходника. Если при следующем запуске
+	// исходник не изменился, результат читается из кеша без трансляции.
+	// Кеш, который не удалось прочитать или записать, не считается ошибкой: исходник просто транслируется.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	extern int translateCached(const char* filename, std::vector<uint8_t>& code, DebugInfo& debug, CacheMode mode);
+}
+
+#endif /* INT6502_CACHE_H */
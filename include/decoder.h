@@ -0,0 +1,116 @@
+#ifndef INT6502_DECODER_H
+#define INT6502_DECODER_H
+
+#include "insn.h"
+#include "fusion.h"
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Предекодированная инструкция
+	struct DecodedInsn {
+		// Значение для IMM, адрес для остальных режимов, адрес перехода для REL.
+		// Для суперинструкции - операнд первой инструкции, у которой он есть
+		uint16_t operand;
+		uint8_t opcode;
+		uint8_t size;      // 0 - слот ещё не декодирован
+		
+		// Суперинструкция, которая начинается с этой инструкции
+		uint16_t handler;  // opcode или FUSION_HANDLER + номер суперинструкции
+		uint16_t operand2; // Операнд второй инструкции, у которой он есть
+		uint8_t count;     // Количество инструкций (1 для обычной инструкции)
+		uint8_t fusedSize; // Суммарный размер
+		
+		uint8_t cycles;      // Базовое количество тактов (см. INT6502_OPCODES)
+		uint8_t fusedCycles; // Суммарное базовое количество тактов суперинструкции
+	};
+	
+	// Декодирует инструкцию по адресу pc
+	extern DecodedInsn decode(const uint8_t* mem, uint16_t pc);
+	
+	
+	// Кэш предекодированных инструкций для области кода, начиная с адреса start (обычно CODE_POS).
+	// Код ниже start декодируется при каждом выполнении.
+	// Слоты заполняются лениво при первом выполнении и сбрасываются
+	// при записи в страницу, из которой были декодированы.
+	class DecodeCache {
+	public:
+		// Получает уведомления о сбросе слотов (например, для сброса скомпилированного кода)
+		class Listener {
+		public:
+			virtual ~Listener() {}
+			
+			virtual void onInvalidate(uint16_t addr) = 0;
+		};
+	
+	private:
+		DecodedInsn slots[MEM_SIZE]; // Слоты ниже start не используются
+		bool decodedPages[0x100];
+		Listener* listener = nullptr;
+		
+		const bool fusion;
+		const uint16_t start;
+		uint64_t fusionHits[FUSION_COUNT];
+		
+		void fill(const uint8_t* mem, uint16_t pc, DecodedInsn& slot);
+	
+	public:
+		// fusion - распознавать суперинструкции, start - начало кэшируемой области кода
+		DecodeCache(bool fusion = true, uint16_t start = CODE_POS);
+		
+		DecodeCache(const DecodeCache&) = delete;
+		
+		inline DecodedInsn fetch(const uint8_t* mem, uint16_t pc) {
+			if (pc < start) {
+				return decode(mem, pc);
+			}
+			
+			DecodedInsn& slot = slots[pc];
+			
+			if (slot.size == 0) {
+				fill(mem, pc, slot);
+			}
+			
+			return slot;
+		}
+		
+		// Начало кэшируемой области кода
+		inline uint16_t getStart() const {
+			return start;
+		}
+		
+		// Вызывается при каждой записи в память по адресу addr
+		inline void onWrite(uint16_t addr) {
+			if (decodedPages[addr >> 8]) {
+				invalidate(addr);
+			}
+		}
+		
+		// Сбрасывает все слоты, которые могут содержать байт по адресу addr
+		void invalidate(uint16_t addr);
+		
+		// Сбрасывает весь кэш
+		void clear();
+		
+		inline void setListener(Listener* listener) {
+			this->listener = listener;
+		}
+		
+		// Учитывает выполнение суперинструкции
+		inline void onFusion(uint16_t handler) {
+			fusionHits[handler - FUSION_HANDLER]++;
+		}
+		
+		// Сколько раз выполнялась каждая суперинструкция
+		inline const uint64_t* getFusionHits() const {
+			return fusionHits;
+		}
+		
+		// Страницы, из которых декодировалась хотя бы одна инструкция
+		inline const bool* getDecodedPages() const {
+			return decodedPages;
+		}
+	};
+}
+
+#endif /* INT6502_DECODER_H */
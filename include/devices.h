@@ -0,0 +1,49 @@
+#ifndef INT6502_DEVICES_H
+#define INT6502_DEVICES_H
+
+#include "bus.h"
+#include "random.h"
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Генератор случайных чисел на RND_POS: каждое чтение возвращает новое значение,
+	// поэтому генератор вызывается только тогда, когда программа его читает
+	class RandomDevice : public Bus::Device {
+		Random& random;
+		
+	public:
+		explicit RandomDevice(Random& random):
+				random(random) {}
+		
+		uint8_t read(uint8_t* mem, uint16_t addr) override {
+			return mem[addr] = random.next();
+		}
+	};
+	
+	
+	// Дисплей на видеопамяти: отмечает, изменялась ли она после публикации последнего кадра.
+	// Используется только потоком выполнения.
+	class DisplayDevice : public Bus::Device {
+		bool changed = true;
+		
+	public:
+		void write(uint8_t* mem, uint16_t addr, uint8_t value) override {
+			mem[addr] = value;
+			changed = true;
+		}
+		
+		inline void mark() {
+			changed = true;
+		}
+		
+		// Возвращает и сбрасывает признак изменения
+		inline bool take() {
+			const bool res = changed;
+			changed = false;
+			return res;
+		}
+	};
+}
+
+#endif /* INT6502_DEVICES_H */
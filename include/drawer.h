@@ -2,6 +2,7 @@
 #define INT6502_DRAW_H
 
 #include <mutex>
+#include <atomic>
 #include <cstdint>
 
 namespace int6502 {
@@ -14,12 +15,116 @@ namespace int6502 {
 			WIN_HEIGHT = HEIGHT_CHARS + 2;
 	
 	
-	extern volatile bool stopped;
+	// Снимок видеопамяти
+	struct Frame {
+		uint8_t cells[WIDTH * HEIGHT];
+	};
 	
-	// Читает 1024 байта из переданного указателя и отображает соответствующие цвета.
-	// При нажатии клавиши записывает её код в inputMem
-	// Выполняется, пока stopped == false
-	extern void draw(uint8_t* inputMem, uint8_t* gpuMem);
+	
+	// Тройной буфер кадров. Поток выполнения записывает кадр в задний буфер и публикует его,
+	// поток отрисовки забирает последний опубликованный кадр. Ни один из потоков не блокируется:
+	// буферы меняются местами атомарной операцией над индексом среднего буфера.
+	// О новом кадре поток отрисовки узнаёт через канал (pipe), который можно ждать вместе с stdin.
+	class FrameBuffer {
+		static const uint8_t FRESH = 0x4; // Средний буфер содержит ещё не забранный кадр
+		
+		Frame frames[3];
+		std::atomic<uint8_t> middle;
+		uint8_t back = 1;  // Принадлежит потоку выполнения
+		uint8_t front = 0; // Принадлежит потоку отрисовки
+		
+		int wakeFds[2];           // Канал для пробуждения потока отрисовки
+		std::atomic<bool> awake;  // В канале уже есть непрочитанный байт
+		std::atomic<bool> closed; // Новых кадров больше не будет
+		
+	public:
+		FrameBuffer();
+		~FrameBuffer();
+		
+		FrameBuffer(const FrameBuffer&) = delete;
+		
+		// Возвращает false, если не удалось создать канал для пробуждения
+		bool isOpen() const;
+		
+		// Копирует видеопамять gpuMem в задний буфер, публикует его и будит поток отрисовки
+		void publish(const uint8_t* gpuMem);
+		
+		// Возвращает последний опубликованный кадр или NULL, если новых кадров не было.
+		// Кадр остаётся действительным до следующего вызова
+		const Frame* acquire();
+		
+		// Будит поток отрисовки, если он ждёт
+		void wake();
+		
+		// Дескриптор, который становится доступен для чтения после wake()
+		int getWakeFd() const;
+		
+		// Сбрасывает состояние, установленное wake(). Вызывается перед acquire()
+		void clearWake();
+		
+		// Сообщает потоку отрисовки, что новых кадров не будет, и будит его
+		void close();
+		
+		bool isClosed() const;
+	};
+	
+	
+	// Ящик для нажатой клавиши. Поток отрисовки кладёт в него код клавиши,
+	// поток выполнения забирает его и записывает в память по адресу INPUT_POS.
+	// Также передаёт команды перемотки: Backspace - шаг назад с паузой, Enter - продолжить выполнение,
+	// и команду остановки программы (Esc)
+	class InputMailbox {
+		std::atomic<uint8_t> key;
+		std::atomic<unsigned> rewinds;
+		std::atomic<bool> resumed;
+		std::atomic<bool> stopped;
+		
+	public:
+		InputMailbox(): key(0), rewinds(0), resumed(false), stopped(false) {}
+		
+		inline void post(uint8_t ch) {
+			key.store(ch, std::memory_order_release);
+		}
+		
+		// Возвращает код последней нажатой клавиши или 0, если клавиша не нажималась
+		inline uint8_t take() {
+			return key.exchange(0, std::memory_order_acquire);
+		}
+		
+		inline void postRewind() {
+			rewinds.fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		// Возвращает, сколько шагов назад запрошено с прошлого вызова
+		inline unsigned takeRewinds() {
+			return rewinds.exchange(0, std::memory_order_relaxed);
+		}
+		
+		inline void postResume() {
+			resumed.store(true, std::memory_order_relaxed);
+		}
+		
+		// Возвращает true, если с прошлого вызова запрошено продолжение выполнения
+		inline bool takeResume() {
+			return resumed.exchange(false, std::memory_order_relaxed);
+		}
+		
+		inline void postStop() {
+			stopped.store(true, std::memory_order_relaxed);
+		}
+		
+		// Возвращает true, если запрошена остановка программы
+		inline bool takeStop() {
+			return stopped.exchange(false, std::memory_order_relaxed);
+		}
+	};
+	
+	
+	// Отображает кадры из frames не чаще maxFps раз в секунду. При нажатии клавиши кладёт её код в input,
+	// а если rewind, Backspace и Enter передаются как команды перемотки.
+	// Поток спит, пока не будет опубликован кадр или нажата клавиша.
+	// Выполняется, пока не будет вызван frames->close()
+	extern void draw(FrameBuffer* frames, InputMailbox* input, unsigned maxFps, bool rewind = false);
 	
 	
 	// Сохраняет цвета и цветовые пары
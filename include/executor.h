@@ -1,12 +1,87 @@
 #ifndef INT6502_EXECUTOR_H
 #define INT6502_EXECUTOR_H
 
+#include "random.h"
+#include "insn.h"
 #include <vector>
+#include <cstdio>
 #include <cstdint>
 
 namespace int6502 {
+	
+	class DecodeCache;
+	class Bus;
+	class Profiler;
+	class Tracer;
+	class Snapshot;
+	class InputRecorder;
+	struct InputLog;
+	
+	
+	// Биты регистра флагов
+	#define FLAG_N(val) (((val) >> 7) & 0x1)
+	#define FLAG_V(val) (((val) >> 6) & 0x1)
+	#define FLAG_B(val) (((val) >> 4) & 0x1)
+	#define FLAG_D(val) (((val) >> 3) & 0x1)
+	#define FLAG_I(val) (((val) >> 2) & 0x1)
+	#define FLAG_Z(val) (((val) >> 1) & 0x1)
+	#define FLAG_C(val) (((val) >> 0) & 0x1)
+	
+	
+	struct processor_state {
+		uint8_t a, x, y, sp;
+		uint16_t pc;
+		uint8_t flags;
+		uint64_t insns;  // Количество выполненных инструкций
+		uint64_t cycles; // Количество тактов, затраченных на их выполнение
+		Random random;   // Генератор случайных чисел для ячейки RND_POS
+	};
+	
+	// Возвращает состояние процессора при запуске программы
+	processor_state initialState();
+	
+	
+	struct ExecuteOptions {
+		bool jit = false;     // Выполнять код с помощью JIT, если он поддерживается
+		bool fusion = true;   // Выполнять частые последовательности инструкций как суперинструкции
+		uint16_t loadAddress = CODE_POS; // Адрес, по которому загружается код
+		uint16_t entry = CODE_POS;       // Адрес, с которого начинается выполнение
+		uint64_t clock = 0;   // Частота эмулируемого процессора в герцах, 0 - без ограничения скорости
+		unsigned maxFps = 60; // Максимальная частота кадров при отрисовке
+		bool seeded = false;  // Использовать seed, иначе генератор инициализируется текущим временем
+		uint64_t seed = 0;    // Начальное значение генератора случайных чисел
+		RandomKind random = RandomKind::XORSHIFT; // Генератор для ячейки RND_POS
+		FILE* stats = NULL;   // Куда записывать статистику выполнения (только в режиме headless)
+		Profiler* profiler = NULL; // Если не NULL, код выполняется интерпретатором без суперинструкций и профилируется
+		Tracer* tracer = NULL;     // Если не NULL, код выполняется интерпретатором без суперинструкций и записывается в трассу
+		const Snapshot* restoreState = NULL; // Если не NULL, выполнение начинается с этого снимка (с seeded генератор инициализируется заново)
+		Snapshot* saveState = NULL;          // Если не NULL, сюда записывается состояние машины после остановки
+		uint64_t rewindInterval = 0; // Тактов между снимками для перемотки назад, 0 - без перемотки (только с интерфейсом)
+		size_t rewindDepth = 1000;   // Сколько снимков хранится для перемотки
+		InputRecorder* recorder = NULL; // Если не NULL, сюда записываются нажатые клавиши
+		const InputLog* replay = NULL;  // Если не NULL, клавиши берутся из записи, а не с клавиатуры
+	};
+	
+	
+	// Выполняет не более limit инструкций, начиная с состояния state, или до инструкции BRK.
+	// Операнды читаются и записываются через шину bus, поэтому обращения к устройствам
+	// вызывают их обработчики. Итоговое состояние записывается в state
+	// (при неизвестной инструкции pc указывает на неё).
+	// Если profiler не NULL и интерпретатор собран с INT6502_PROFILER, выполнение профилируется.
+	// Если tracer не NULL, каждая инструкция (в том числе неизвестная) записывается в трассу.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	int run(Bus& bus, DecodeCache& cache, processor_state* state, uint64_t limit, Profiler* profiler = NULL, Tracer* tracer = NULL);
+	
+	// Способ диспетчеризации инструкций, с которым собран интерпретатор: "switch" или "threaded"
+	const char* getDispatchName();
+	
 	// Выполняет переданный код. Возвращает 0 в случае успеха, иначе код ошибки.
-	int executeCode(const std::vector<uint8_t>& code);
+	int executeCode(const std::vector<uint8_t>& code, const ExecuteOptions& options);
+	
+	// Выполняет переданный код без ncurses и потока отрисовки.
+	// Итоговое состояние процессора и дамп памяти записываются в out.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	int executeCodeHeadless(const std::vector<uint8_t>& code, FILE* out, const ExecuteOptions& options);
 }
 
 #endif /* INT6502_EXECUTOR_H */
@@ -0,0 +1,51 @@
+#ifndef INT6502_FUSION_H
+#define INT6502_FUSION_H
+
+#include "insn.h"
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Список суперинструкций - последовательностей, которые выполняются одним обработчиком.
+	// Для каждой вызывается X(имя, описание, опкоды...).
+	// Читать память может только первая инструкция последовательности,
+	// записывать - только последняя.
+	#define INT6502_FUSIONS(X) \
+		X(INX_CPX_BNE,         "inx; cpx #imm; bne",   INX, CPX_IMM, BNE) \
+		X(INY_CPY_BNE,         "iny; cpy #imm; bne",   INY, CPY_IMM, BNE) \
+		X(DEX_BNE,             "dex; bne",             DEX, BNE) \
+		X(DEY_BNE,             "dey; bne",             DEY, BNE) \
+		X(CMP_IMM_BEQ,         "cmp #imm; beq",        CMP_IMM, BEQ) \
+		X(CMP_IMM_BNE,         "cmp #imm; bne",        CMP_IMM, BNE) \
+		X(LDA_ABS_X_STA_ABS_X, "lda abs,x; sta abs,x", LDA_ABS_X, STA_ABS_X) \
+		X(LDA_IMM_STA_ZP,      "lda #imm; sta zp",     LDA_IMM, STA_ZP) \
+		X(LDA_IMM_STA_ABS,     "lda #imm; sta abs",    LDA_IMM, STA_ABS) \
+		X(LDA_ZP_STA_ZP,       "lda zp; sta zp",       LDA_ZP, STA_ZP)
+	
+	
+	enum Fusion {
+		#define FUSION_ENUM(name, description, ...) FUSION_##name,
+		INT6502_FUSIONS(FUSION_ENUM)
+		#undef FUSION_ENUM
+		
+		FUSION_COUNT
+	};
+	
+	// Номера обработчиков суперинструкций идут после номеров обычных опкодов
+	static const uint16_t FUSION_HANDLER = 0x100;
+	
+	// Максимальный суммарный размер суперинструкции в байтах
+	static const uint8_t MAX_FUSED_SIZE = 6;
+	
+	
+	// Возвращает описание суперинструкции
+	extern const char* getFusionDescription(Fusion fusion);
+	
+	struct DecodedInsn;
+	
+	// Ищет суперинструкцию, которая начинается с инструкции insn по адресу pc,
+	// и записывает её в insn. Возвращает false, если ни одна не подходит.
+	extern bool fuse(const uint8_t* mem, uint16_t pc, DecodedInsn& insn);
+}
+
+#endif /* INT6502_FUSION_H */
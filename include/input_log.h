@@ -0,0 +1,70 @@
+#ifndef INT6502_INPUT_LOG_H
+#define INT6502_INPUT_LOG_H
+
+#include "executor.h"
+#include "random.h"
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Нажатие клавиши, записанное в INPUT_POS перед выполнением инструкции номер insns
+	struct InputEvent {
+		uint64_t insns;
+		uint64_t cycles; // Для справки: воспроизведение ориентируется на insns
+		uint8_t key;
+	};
+	
+	
+	// Запись ввода, прочитанная из файла. Формат текстовый, по строке на запись:
+	//   int6502-input 1            - заголовок с версией
+	//   seed <n> <генератор>       - начальное значение генератора, если его задавал сам запуск
+	//   key <insns> <cycles> <код> - нажатие клавиши (код в шестнадцатеричном виде)
+	//   rewind <insns> <cycles>    - перемотка назад: события начиная с insns отменяются
+	//   stop <insns> <cycles>      - выполнение остановлено
+	struct InputLog {
+		bool seeded = false;
+		uint64_t seed = 0;
+		RandomKind random = RandomKind::XORSHIFT;
+		
+		std::vector<InputEvent> events; // Упорядочены по insns, перемотки уже применены
+		
+		// Если записи stop нет (запись прервана), воспроизведение останавливается на последнем событии
+		bool stopped = false;
+		uint64_t stopInsns = 0;
+		
+		// Читает запись из файла. Возвращает 0 в случае успеха, иначе код ошибки.
+		int load(const char* filename);
+	};
+	
+	
+	// Записывает ввод в файл по мере выполнения. Каждая запись сразу сбрасывается на диск,
+	// поэтому при аварийном завершении теряется только запись stop
+	class InputRecorder {
+		FILE* file = nullptr;
+		
+		void write(const char* type, const processor_state& state);
+	
+	public:
+		InputRecorder() {}
+		~InputRecorder();
+		
+		InputRecorder(const InputRecorder&) = delete;
+		
+		// Создаёт файл и записывает заголовок. Возвращает 0 в случае успеха, иначе код ошибки.
+		int open(const char* filename);
+		
+		void recordSeed(uint64_t seed, RandomKind random);
+		
+		// Клавиша key записана в память в состоянии state
+		void recordKey(const processor_state& state, uint8_t key);
+		
+		// Машина перемотана назад к состоянию state
+		void recordRewind(const processor_state& state);
+		
+		void recordStop(const processor_state& state);
+	};
+}
+
+#endif /* INT6502_INPUT_LOG_H */
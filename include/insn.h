@@ -1,6 +1,7 @@
 #ifndef INT6502_INSN_H
 #define INT6502_INSN_H
 
+#include "symbols.h"
 #include <functional>
 #include <string>
 #include <vector>
@@ -8,9 +9,12 @@
 
 namespace int6502 {
 	
+	static const size_t MEM_SIZE = 0x10000;
+	
 	static const uint16_t
 			STACK_POS = 0x100,
 			GPU_POS   = 0x200,
+			GPU_SIZE  = 0x400,
 			CODE_POS  = 0x600,
 			RND_POS   = 0xFE,
 			INPUT_POS = 0xFF;
@@ -191,48 +195,46 @@ namespace int6502 {
 	};
 	
 	
-	// Таблица define-ов
-	class DefineTable {
-	public:
-		std::map<std::string, std::string> table;
-		
-	public:
-		DefineTable() {}
-		
-		DefineTable(const DefineTable&) = delete;
-		
-		// Возвращает значение по ключу или сам ключ
-		inline const std::string& operator[](const std::string& key) const {
-			auto found = table.find(key);
-			return found != table.end() ? found->second : key;
-		}
-		
-		inline std::string& operator[](const std::string& key) {
-			std::string& val = table[key];
-			
-			if (val.empty()) {
-				val = key;
-			}
-			
-			return val;
-		}
+	enum class AddrMode {
+		REL, // one-byte signed address
+		ABS, // two-byte unsigned address
+	};
+	
+	// Ссылка на лейбл, адрес которого подставляется после трансляции всего файла
+	struct RequiredLabel {
+		size_t pos;
+		AddrMode mode;
+		int lineNum;
+		int column;
+		Symbol label;
+		
+		RequiredLabel(size_t pos, AddrMode mode, int lineNum, int column, Symbol label):
+				pos(pos), mode(mode), lineNum(lineNum), column(column), label(label) {}
+	};
+	
+	
+	// Состояние ассемблера на время трансляции одного файла
+	struct AssemblerState {
+		SymbolTable symbols; // Имена и значения define-ов, лейблы и их смещения относительно начала кода
+		std::vector<RequiredLabel> requiredLabels; // Места, куда нужно подставить адреса лейблов
+		int operandColumn = 1; // Столбец начала операнда текущей строки (с 1) для сообщений об ошибках
 	};
 	
 	
 	// Параметры:
 	// - Название операции
 	// - Оставшиеся операнды
-	// - Таблица define-ов
+	// - Состояние ассемблера
 	// - Номер строки (начиная с 1)
 	// - Результирующий код
 	// Возвращает EXIT_SUCCESS, если всё норм, иначе код ошибки.
-	using InsnFunction = std::function<int(const std::string&, const std::string&, DefineTable&, int, std::vector<uint8_t>&)>;
+	using InsnFunction = std::function<int(const std::string&, const std::string&, AssemblerState&, int, std::vector<uint8_t>&)>;
 	
 	// Возвращает карту, где ключ - название инструкции, значение - функция этой инструкции
 	extern std::map<std::string, InsnFunction> createInsnTable();
 	
-	// Инициализирует лейблы
-	extern int initLabels(std::vector<uint8_t>& code, std::map<std::string, size_t>& labels);
+	// Подставляет адреса лейблов в код
+	extern int initLabels(std::vector<uint8_t>& code, const AssemblerState& state);
 }
 
 #endif /* INT6502_INSN_H */
@@ -0,0 +1,48 @@
+#ifndef INT6502_JIT_H
+#define INT6502_JIT_H
+
+#include "executor.h"
+#include <memory>
+#include <cstdint>
+
+namespace int6502 {
+	
+	struct JitStats {
+		uint64_t blocks = 0;        // Количество скомпилированных блоков
+		uint64_t nativeInsns = 0;   // Инструкций выполнено в скомпилированном коде
+		uint64_t fallbackInsns = 0; // Инструкций выполнено интерпретатором
+		uint64_t invalidations = 0; // Блоков сброшено из-за самомодифицирующегося кода
+		double compileSeconds = 0;  // Время, затраченное на компиляцию
+	};
+	
+	
+	// Компилирует базовые блоки 6502 в машинный код x86-64.
+	// Регистры A, X, Y, SP и флаги хранятся в регистрах хоста, блоки связываются
+	// друг с другом напрямую. Неподдерживаемые инструкции выполняются интерпретатором.
+	// При записи в скомпилированный код соответствующие блоки сбрасываются.
+	class Jit {
+	public:
+		struct Impl; // Реализация зависит от платформы
+	
+	private:
+		std::unique_ptr<Impl> impl;
+	
+	public:
+		// bus и cache должны существовать, пока существует Jit. Отображение устройств
+		// учитывается при компиляции, поэтому после его изменения Jit нужно создать заново
+		Jit(Bus& bus, DecodeCache& cache);
+		~Jit();
+		
+		Jit(const Jit&) = delete;
+		
+		// Возвращает true, если JIT поддерживается на этой платформе
+		static bool isSupported();
+		
+		// То же, что и run() из executor.h
+		int run(processor_state* state, uint64_t limit);
+		
+		const JitStats& getStats() const;
+	};
+}
+
+#endif /* INT6502_JIT_H */
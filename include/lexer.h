@@ -0,0 +1,70 @@
+#ifndef INT6502_LEXER_H
+#define INT6502_LEXER_H
+
+#include <string>
+#include <cstddef>
+
+namespace int6502 {
+	
+	enum class TokenKind {
+		WORD,    // Число, лейбл, имя из define или регистр: [$0-9A-Za-z_]+
+		HASH,    // #
+		LPAREN,  // (
+		RPAREN,  // )
+		COMMA,   // ,
+		END,     // Конец строки
+		INVALID, // Любой другой символ
+	};
+	
+	struct Token {
+		TokenKind kind;
+		size_t pos;    // Смещение в строке
+		size_t length;
+	};
+	
+	
+	// Разбивает строку на лексемы за один проход без выделения памяти. Пробелы между лексемами пропускаются
+	class Lexer {
+		const std::string& str;
+		size_t pos;
+	
+	public:
+		explicit Lexer(const std::string& str, size_t pos = 0):
+				str(str), pos(pos) {}
+		
+		// Возвращает следующую лексему. В конце строки каждый раз возвращает END
+		Token next();
+		
+		inline std::string text(const Token& token) const {
+			return str.substr(token.pos, token.length);
+		}
+		
+		// Возвращает true, если лексема - слово из одной буквы c (без учёта регистра)
+		bool isRegister(const Token& token, char c) const;
+	};
+	
+	
+	enum class OperandKind {
+		IMMEDIATE,  // #value
+		DIRECT,     // value
+		INDEXED_X,  // value,x
+		INDEXED_Y,  // value,y
+		INDIRECT,   // (value)
+		INDIRECT_X, // (value,x)
+		INDIRECT_Y, // (value),y
+	};
+	
+	// Операнд инструкции после разбора
+	struct Operand {
+		OperandKind kind;
+		Token value; // Число, лейбл или имя из define без '#', скобок и регистров
+		int column;  // Столбец value в строке исходника (начиная с 1)
+	};
+	
+	
+	// Разбирает непустой операнд str, начинающийся в столбце column строки lineNum.
+	// Возвращает 0 в случае успеха, иначе код ошибки (сообщение указывает столбец).
+	int parseOperand(const std::string& str, int lineNum, int column, Operand& operand);
+}
+
+#endif /* INT6502_LEXER_H */
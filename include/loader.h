@@ -0,0 +1,49 @@
+#ifndef INT6502_LOADER_H
+#define INT6502_LOADER_H
+
+#include "insn.h"
+#include <vector>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Список форматов программ. Для каждого вызывается X(имя, название в параметре --format).
+	#define INT6502_IMAGE_FORMATS(X) \
+		X(SOURCE, "source") \
+		X(RAW,    "raw")    \
+		X(PRG,    "prg")    \
+		X(HEX,    "hex")
+	
+	enum class ImageFormat : uint8_t {
+		#define IMAGE_FORMAT_ENUM(name, option) name,
+		INT6502_IMAGE_FORMATS(IMAGE_FORMAT_ENUM)
+		#undef IMAGE_FORMAT_ENUM
+	};
+	
+	// Ищет формат по названию. Возвращает false, если такого нет
+	extern bool parseImageFormat(const char* name, ImageFormat& format);
+	
+	// Определяет формат по расширению файла: .prg - PRG, .hex, .ihx и .ihex - Intel HEX,
+	// .bin и .raw - двоичный образ, остальные - исходник на ассемблере
+	extern ImageFormat detectImageFormat(const char* filename);
+	
+	
+	// Машинный код, который загружается в память одним участком
+	struct Image {
+		std::vector<uint8_t> code;
+		uint16_t addr = CODE_POS;  // Адрес, по которому загружается code
+		uint16_t entry = CODE_POS; // Адрес, с которого начинается выполнение
+	};
+	
+	// Загружает программу из файла в формате format:
+	//   SOURCE - транслирует исходник, код загружается по адресу CODE_POS;
+	//   RAW    - файл целиком загружается по адресу image.addr;
+	//   PRG    - первые два байта файла - адрес загрузки (little-endian), за ними код;
+	//   HEX    - записи Intel HEX. Промежутки между записями заполняются нулями,
+	//            адрес начала выполнения берётся из записи типа 03 или 05, если она есть.
+	// Кроме HEX с адресом начала, выполнение начинается с адреса загрузки.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	extern int loadImage(const char* filename, ImageFormat format, Image& image);
+}
+
+#endif /* INT6502_LOADER_H */
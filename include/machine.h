@@ -0,0 +1,140 @@
+#ifndef INT6502_MACHINE_H
+#define INT6502_MACHINE_H
+
+#include "executor.h"
+#include "bus.h"
+#include "devices.h"
+#include "snapshot.h"
+#include "jit.h"
+#include <functional>
+#include <istream>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace int6502 {
+	
+	class DecodeCache;
+	
+	
+	struct MachineOptions {
+		bool jit = false;    // Выполнять код с помощью JIT, если он поддерживается
+		bool fusion = true;  // Выполнять частые последовательности инструкций как суперинструкции
+		uint64_t seed = 1;   // Начальное значение генератора случайных чисел для ячейки RND_POS
+		RandomKind random = RandomKind::XORSHIFT; // Алгоритм этого генератора
+		
+		// Если не NULL, код выполняется интерпретатором без JIT и суперинструкций,
+		// чтобы профилировщик видел каждую инструкцию. Должен существовать, пока существует машина
+		Profiler* profiler = nullptr;
+		
+		// Если не NULL, каждая выполненная инструкция записывается в трассу (тоже без JIT и суперинструкций).
+		// Должен существовать, пока существует машина
+		Tracer* tracer = nullptr;
+	};
+	
+	
+	// Эмулятор 6502 со всем своим состоянием: памятью, шиной с устройствами, регистрами, кэшем декодирования и JIT.
+	// Экземпляры не разделяют между собой никакого состояния, поэтому в одном процессе
+	// может работать сколько угодно машин, в том числе в разных потоках
+	// (но каждая машина одновременно используется только одним потоком).
+	class Machine {
+	public:
+		// Вызывается с содержимым видеопамяти, если она изменилась с прошлого вызова
+		using FrameHandler = std::function<void(const uint8_t* gpuMem)>;
+	
+	private:
+		std::unique_ptr<uint8_t[]> mem;
+		processor_state state;
+		Bus bus;
+		RandomDevice random;
+		DisplayDevice display;
+		std::unique_ptr<DecodeCache> cache;
+		std::unique_ptr<Jit> jit;
+		uint16_t codeStart = CODE_POS; // Начало области кода для кэша декодирования и JIT
+		FrameHandler frameHandler;
+		const MachineOptions options;
+		
+		// Вызывает обработчик кадров, если видеопамять изменилась
+		void flushFrame();
+	
+	public:
+		explicit Machine(const MachineOptions& options = MachineOptions());
+		~Machine();
+		
+		Machine(const Machine&) = delete;
+		
+		// Транслирует программу из файла и загружает её. Возвращает 0 в случае успеха, иначе код ошибки.
+		int assemble(const char* filename);
+		
+		// Транслирует программу из потока и загружает её. Возвращает 0 в случае успеха, иначе код ошибки.
+		int assemble(std::istream& source);
+		
+		// Обнуляет память, загружает в неё code по адресу addr и сбрасывает процессор.
+		// Выполнение начинается с адреса entry. Возвращает 0 в случае успеха, иначе код ошибки.
+		int load(const std::vector<uint8_t>& code, uint16_t addr = CODE_POS, uint16_t entry = CODE_POS);
+		
+		// Выполняет не более count инструкций или до инструкции BRK.
+		// После выполнения вызывает обработчик кадров, если видеопамять изменилась.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int step(uint64_t count);
+		
+		// Выполняет инструкции, пока счётчик тактов не достигнет cycles
+		// (последняя инструкция может его немного превысить) или до инструкции BRK.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int runUntil(uint64_t cycles);
+		
+		// Выполняет программу до инструкции BRK. Возвращает 0 в случае успеха, иначе код ошибки.
+		int run();
+		
+		// Делает снимок состояния машины (копирование 64 КиБ, микросекунды).
+		// Если base не NULL, неизменившиеся с него страницы памяти разделяются с ним
+		Snapshot snapshot(const Snapshot* base = nullptr) const;
+		
+		// Восстанавливает состояние из снимка (в том числе генератор случайных чисел).
+		// Копируются только страницы, отличающиеся от текущей памяти, и только для них сбрасывается
+		// кэш декодирования и скомпилированный код. Восстановленный кадр сразу передаётся обработчику кадров. Если снимок сделан после остановки на BRK,
+		// флаг B сбрасывается, чтобы выполнение продолжилось со следующей инструкции.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int restore(const Snapshot& snapshot);
+		
+		// Инициализирует генератор случайных чисел заново (например, после restore)
+		void reseed(uint64_t seed);
+		
+		// Возвращает true, если выполнена инструкция BRK
+		bool isStopped() const;
+		
+		inline const processor_state& getState() const {
+			return state;
+		}
+		
+		inline uint8_t* getMemory() {
+			return mem.get();
+		}
+		
+		inline const uint8_t* getMemory() const {
+			return mem.get();
+		}
+		
+		// Записывает код нажатой клавиши по адресу INPUT_POS
+		void setInput(uint8_t key);
+		
+		// Отображает на шину дополнительное устройство (см. Bus::map). JIT сбрасывается,
+		// так как скомпилированный код обращается к памяти без проверки устройств там, где их не было.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int mapDevice(Bus::Device* device, uint16_t first, uint16_t last, unsigned access);
+		
+		void unmapDevice(Bus::Device* device);
+		
+		// Устанавливает обработчик кадров. Лучше вызывать до начала выполнения:
+		// при замене обработчика JIT сбрасывает скомпилированный код и статистику
+		void setFrameHandler(FrameHandler handler);
+		
+		// Возвращает NULL, если JIT не используется
+		const JitStats* getJitStats() const;
+		
+		// Сколько раз выполнялась каждая суперинструкция (массив длины FUSION_COUNT)
+		const uint64_t* getFusionHits() const;
+	};
+}
+
+#endif /* INT6502_MACHINE_H */
@@ -0,0 +1,48 @@
+#ifndef INT6502_MAPPED_FILE_H
+#define INT6502_MAPPED_FILE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Содержимое файла только для чтения. Обычные файлы отображаются в память (mmap) целиком,
+	// каналы, пустые файлы и файлы на платформах без mmap читаются в буфер
+	class MappedFile {
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+		std::vector<uint8_t> buffer;
+	
+	public:
+		MappedFile() {}
+		~MappedFile();
+		
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		
+		// Открывает файл. Если quiet, сообщение об ошибке не выводится.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int open(const char* filename, bool quiet = false);
+		
+		inline const uint8_t* getData() const {
+			return data;
+		}
+		
+		inline const char* getChars() const {
+			return reinterpret_cast<const char*>(data);
+		}
+		
+		inline size_t getSize() const {
+			return size;
+		}
+		
+		// Возвращает true, если файл отображён в память, а не прочитан в буфер
+		inline bool isMapped() const {
+			return mapped;
+		}
+	};
+}
+
+#endif /* INT6502_MAPPED_FILE_H */
@@ -0,0 +1,225 @@
+#ifndef INT6502_OPCODES_H
+#define INT6502_OPCODES_H
+
+#include "insn.h"
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Режимы адресации
+	enum class Addressing : uint8_t {
+		IMP,   // без операнда
+		ACC,   // аккумулятор
+		IMM,   // #$nn
+		ZP,    // $nn
+		ZP_X,  // $nn,x
+		ZP_Y,  // $nn,y
+		ABS,   // $nnnn
+		ABS_X, // $nnnn,x
+		ABS_Y, // $nnnn,y
+		IND,   // ($nnnn)
+		IND_X, // ($nn,x)
+		IND_Y, // ($nn),y
+		REL,   // однобайтовое смещение перехода
+	};
+	
+	
+	// Список всех поддерживаемых инструкций.
+	// Для каждой вызывается X(опкод, мнемоника, режим адресации, количество тактов).
+	// Количество тактов указано без дополнительных тактов за пересечение границы страницы
+	// при чтении в режимах $nnnn,x, $nnnn,y, ($nn),y и за выполненный переход.
+	#define INT6502_OPCODES(X) \
+		X(LDA_IMM,   "lda", IMM,   2) \
+		X(LDA_ZP,    "lda", ZP,    3) \
+		X(LDA_ZP_X,  "lda", ZP_X,  4) \
+		X(LDA_ABS,   "lda", ABS,   4) \
+		X(LDA_ABS_X, "lda", ABS_X, 4) \
+		X(LDA_ABS_Y, "lda", ABS_Y, 4) \
+		X(LDA_IND_X, "lda", IND_X, 6) \
+		X(LDA_IND_Y, "lda", IND_Y, 5) \
+		\
+		X(LDX_IMM,   "ldx", IMM,   2) \
+		X(LDX_ZP,    "ldx", ZP,    3) \
+		X(LDX_ZP_Y,  "ldx", ZP_Y,  4) \
+		X(LDX_ABS,   "ldx", ABS,   4) \
+		X(LDX_ABS_Y, "ldx", ABS_Y, 4) \
+		\
+		X(LDY_IMM,   "ldy", IMM,   2) \
+		X(LDY_ZP,    "ldy", ZP,    3) \
+		X(LDY_ZP_X,  "ldy", ZP_X,  4) \
+		X(LDY_ABS,   "ldy", ABS,   4) \
+		X(LDY_ABS_X, "ldy", ABS_X, 4) \
+		\
+		X(STA_ZP,    "sta", ZP,    3) \
+		X(STA_ZP_X,  "sta", ZP_X,  4) \
+		X(STA_ABS,   "sta", ABS,   4) \
+		X(STA_ABS_X, "sta", ABS_X, 5) \
+		X(STA_ABS_Y, "sta", ABS_Y, 5) \
+		X(STA_IND_X, "sta", IND_X, 6) \
+		X(STA_IND_Y, "sta", IND_Y, 6) \
+		\
+		X(STX_ZP,    "stx", ZP,    3) \
+		X(STX_ZP_Y,  "stx", ZP_Y,  4) \
+		X(STX_ABS,   "stx", ABS,   4) \
+		\
+		X(STY_ZP,    "sty", ZP,    3) \
+		X(STY_ZP_X,  "sty", ZP_X,  4) \
+		X(STY_ABS,   "sty", ABS,   4) \
+		\
+		X(CMP_IMM,   "cmp", IMM,   2) \
+		X(CMP_ZP,    "cmp", ZP,    3) \
+		X(CMP_ZP_X,  "cmp", ZP_X,  4) \
+		X(CMP_ABS,   "cmp", ABS,   4) \
+		X(CMP_ABS_X, "cmp", ABS_X, 4) \
+		X(CMP_ABS_Y, "cmp", ABS_Y, 4) \
+		X(CMP_IND_X, "cmp", IND_X, 6) \
+		X(CMP_IND_Y, "cmp", IND_Y, 5) \
+		\
+		X(CPX_IMM,   "cpx", IMM,   2) \
+		X(CPX_ZP,    "cpx", ZP,    3) \
+		X(CPX_ABS,   "cpx", ABS,   4) \
+		\
+		X(CPY_IMM,   "cpy", IMM,   2) \
+		X(CPY_ZP,    "cpy", ZP,    3) \
+		X(CPY_ABS,   "cpy", ABS,   4) \
+		\
+		X(BIT_ZP,    "bit", ZP,    3) \
+		X(BIT_ABS,   "bit", ABS,   4) \
+		\
+		X(AND_IMM,   "and", IMM,   2) \
+		X(AND_ZP,    "and", ZP,    3) \
+		X(AND_ZP_X,  "and", ZP_X,  4) \
+		X(AND_ABS,   "and", ABS,   4) \
+		X(AND_ABS_X, "and", ABS_X, 4) \
+		X(AND_ABS_Y, "and", ABS_Y, 4) \
+		X(AND_IND_X, "and", IND_X, 6) \
+		X(AND_IND_Y, "and", IND_Y, 5) \
+		\
+		X(ORA_IMM,   "ora", IMM,   2) \
+		X(ORA_ZP,    "ora", ZP,    3) \
+		X(ORA_ZP_X,  "ora", ZP_X,  4) \
+		X(ORA_ABS,   "ora", ABS,   4) \
+		X(ORA_ABS_X, "ora", ABS_X, 4) \
+		X(ORA_ABS_Y, "ora", ABS_Y, 4) \
+		X(ORA_IND_X, "ora", IND_X, 6) \
+		X(ORA_IND_Y, "ora", IND_Y, 5) \
+		\
+		X(EOR_IMM,   "eor", IMM,   2) \
+		X(EOR_ZP,    "eor", ZP,    3) \
+		X(EOR_ZP_X,  "eor", ZP_X,  4) \
+		X(EOR_ABS,   "eor", ABS,   4) \
+		X(EOR_ABS_X, "eor", ABS_X, 4) \
+		X(EOR_ABS_Y, "eor", ABS_Y, 4) \
+		X(EOR_IND_X, "eor", IND_X, 6) \
+		X(EOR_IND_Y, "eor", IND_Y, 5) \
+		\
+		X(ADC_IMM,   "adc", IMM,   2) \
+		X(ADC_ZP,    "adc", ZP,    3) \
+		X(ADC_ZP_X,  "adc", ZP_X,  4) \
+		X(ADC_ABS,   "adc", ABS,   4) \
+		X(ADC_ABS_X, "adc", ABS_X, 4) \
+		X(ADC_ABS_Y, "adc", ABS_Y, 4) \
+		X(ADC_IND_X, "adc", IND_X, 6) \
+		X(ADC_IND_Y, "adc", IND_Y, 5) \
+		\
+		X(SBC_IMM,   "sbc", IMM,   2) \
+		X(SBC_ZP,    "sbc", ZP,    3) \
+		X(SBC_ZP_X,  "sbc", ZP_X,  4) \
+		X(SBC_ABS,   "sbc", ABS,   4) \
+		X(SBC_ABS_X, "sbc", ABS_X, 4) \
+		X(SBC_ABS_Y, "sbc", ABS_Y, 4) \
+		X(SBC_IND_X, "sbc", IND_X, 6) \
+		X(SBC_IND_Y, "sbc", IND_Y, 5) \
+		\
+		X(ASL_A,     "asl", ACC,   2) \
+		X(ASL_ZP,    "asl", ZP,    5) \
+		X(ASL_ZP_X,  "asl", ZP_X,  6) \
+		X(ASL_ABS,   "asl", ABS,   6) \
+		X(ASL_ABS_X, "asl", ABS_X, 7) \
+		\
+		X(LSR_A,     "lsr", ACC,   2) \
+		X(LSR_ZP,    "lsr", ZP,    5) \
+		X(LSR_ZP_X,  "lsr", ZP_X,  6) \
+		X(LSR_ABS,   "lsr", ABS,   6) \
+		X(LSR_ABS_X, "lsr", ABS_X, 7) \
+		\
+		X(ROL_A,     "rol", ACC,   2) \
+		X(ROL_ZP,    "rol", ZP,    5) \
+		X(ROL_ZP_X,  "rol", ZP_X,  6) \
+		X(ROL_ABS,   "rol", ABS,   6) \
+		X(ROL_ABS_X, "rol", ABS_X, 7) \
+		\
+		X(ROR_A,     "ror", ACC,   2) \
+		X(ROR_ZP,    "ror", ZP,    5) \
+		X(ROR_ZP_X,  "ror", ZP_X,  6) \
+		X(ROR_ABS,   "ror", ABS,   6) \
+		X(ROR_ABS_X, "ror", ABS_X, 7) \
+		\
+		X(INC_ZP,    "inc", ZP,    5) \
+		X(INC_ZP_X,  "inc", ZP_X,  6) \
+		X(INC_ABS,   "inc", ABS,   6) \
+		X(INC_ABS_X, "inc", ABS_X, 7) \
+		\
+		X(DEC_ZP,    "dec", ZP,    5) \
+		X(DEC_ZP_X,  "dec", ZP_X,  6) \
+		X(DEC_ABS,   "dec", ABS,   6) \
+		X(DEC_ABS_X, "dec", ABS_X, 7) \
+		\
+		X(INX,       "inx", IMP,   2) \
+		X(INY,       "iny", IMP,   2) \
+		X(DEX,       "dex", IMP,   2) \
+		X(DEY,       "dey", IMP,   2) \
+		\
+		X(CLC,       "clc", IMP,   2) \
+		X(CLI,       "cli", IMP,   2) \
+		X(CLD,       "cld", IMP,   2) \
+		X(CLV,       "clv", IMP,   2) \
+		X(SEC,       "sec", IMP,   2) \
+		X(SEI,       "sei", IMP,   2) \
+		X(SED,       "sed", IMP,   2) \
+		\
+		X(TAX,       "tax", IMP,   2) \
+		X(TXA,       "txa", IMP,   2) \
+		X(TAY,       "tay", IMP,   2) \
+		X(TYA,       "tya", IMP,   2) \
+		X(TSX,       "tsx", IMP,   2) \
+		X(TXS,       "txs", IMP,   2) \
+		\
+		X(PHA,       "pha", IMP,   3) \
+		X(PHP,       "php", IMP,   3) \
+		X(PLA,       "pla", IMP,   4) \
+		X(PLP,       "plp", IMP,   4) \
+		\
+		X(NOP,       "nop", IMP,   2) \
+		\
+		X(BEQ,       "beq", REL,   2) \
+		X(BNE,       "bne", REL,   2) \
+		X(BMI,       "bmi", REL,   2) \
+		X(BPL,       "bpl", REL,   2) \
+		X(BCS,       "bcs", REL,   2) \
+		X(BCC,       "bcc", REL,   2) \
+		X(BVS,       "bvs", REL,   2) \
+		X(BVC,       "bvc", REL,   2) \
+		\
+		X(JMP_ABS,   "jmp", ABS,   3) \
+		X(JMP_IND,   "jmp", IND,   5) \
+		\
+		X(JSR,       "jsr", ABS,   6) \
+		X(RTS,       "rts", IMP,   6) \
+		\
+		X(BRK,       "brk", IMP,   7) \
+		X(RTI,       "rti", IMP,   6)
+	
+	
+	struct OpcodeInfo {
+		const char* mnemonic; // NULL, если инструкция неизвестна
+		Addressing mode;
+		uint8_t size;         // 0, если инструкция неизвестна
+		uint8_t cycles;       // Базовое количество тактов
+	};
+	
+	// Возвращает описание инструкции по её опкоду
+	extern const OpcodeInfo& getOpcodeInfo(uint8_t opcode);
+}
+
+#endif /* INT6502_OPCODES_H */
@@ -0,0 +1,96 @@
+#ifndef INT6502_PROFILER_H
+#define INT6502_PROFILER_H
+
+#include "translator.h"
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Профилировщик интерпретатора: считает выполнения и такты по опкодам и адресам,
+	// выполненные и невыполненные переходы и такты по стекам вызовов (по JSR/RTS).
+	// Интерпретатор вызывает его, только если собран с -DINT6502_PROFILER=ON,
+	// иначе вызовы убираются при компиляции и профилирование ничего не стоит.
+	class Profiler {
+		struct Counter {
+			uint64_t count = 0;
+			uint64_t cycles = 0;
+		};
+		
+		struct PcCounter : Counter {
+			uint64_t taken = 0; // Для переходов: сколько раз переход выполнен
+			uint8_t opcode = 0; // Последний выполненный по этому адресу опкод
+		};
+		
+		// Узел дерева вызовов
+		struct Frame {
+			uint16_t entry;  // Адрес подпрограммы
+			uint32_t parent;
+			uint64_t cycles; // Такты, затраченные в самой подпрограмме (без вызванных из неё)
+		};
+		
+		// Ограничение глубины стека вызовов для программ, которые не возвращаются из подпрограмм через RTS
+		static const size_t MAX_DEPTH = 256;
+		
+		Counter opcodes[0x100];
+		std::vector<PcCounter> pcs;
+		std::vector<Frame> frames; // frames[0] - код вне подпрограмм
+		std::unordered_map<uint64_t, uint32_t> children; // (родитель << 16 | адрес) -> узел
+		std::vector<uint32_t> callStack;
+		uint64_t skippedCalls = 0; // Вызовы сверх MAX_DEPTH: такты учитываются в подпрограмме на глубине MAX_DEPTH
+		uint32_t frame = 0;
+		
+		// Инструкция, такты которой ещё не учтены
+		bool pending = false;
+		uint16_t lastPc;
+		uint8_t lastOpcode;
+		uint64_t lastCycles;
+		
+		// Учитывает инструкцию pending. nextPc - адрес следующей выполненной инструкции
+		void account(uint16_t nextPc, uint64_t cycles);
+		
+		std::string getFramePath(uint32_t index, const DebugInfo* debug) const;
+	
+	public:
+		Profiler();
+		
+		Profiler(const Profiler&) = delete;
+		
+		// Возвращает true, если интерпретатор собран с поддержкой профилирования
+		static bool isSupported();
+		
+		// Вызывается перед выполнением каждой инструкции. cycles - счётчик тактов до её выполнения
+		inline void step(uint16_t pc, uint8_t opcode, uint64_t cycles) {
+			if (pending) {
+				account(pc, cycles);
+			}
+			
+			pending = true;
+			lastPc = pc;
+			lastOpcode = opcode;
+			lastCycles = cycles;
+		}
+		
+		// Вызывается при выходе из интерпретатора: учитывает последнюю инструкцию.
+		// pc - адрес следующей инструкции, cycles - итоговый счётчик тактов
+		inline void flush(uint16_t pc, uint64_t cycles) {
+			if (pending) {
+				account(pc, cycles);
+				pending = false;
+			}
+		}
+		
+		// Записывает отчёт: такты по опкодам, самые горячие адреса и статистику переходов.
+		// Адреса отображаются в строки исходника и лейблы по debug (может быть NULL).
+		void writeReport(FILE* out, const DebugInfo* debug) const;
+		
+		// Записывает такты по стекам вызовов в формате folded stacks
+		// (flamegraph.pl, inferno, speedscope): "main;sub1;sub2 cycles"
+		void writeFolded(FILE* out, const DebugInfo* debug) const;
+	};
+}
+
+#endif /* INT6502_PROFILER_H */
@@ -0,0 +1,54 @@
+#ifndef INT6502_RANDOM_H
+#define INT6502_RANDOM_H
+
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Список генераторов случайных чисел для ячейки RND_POS.
+	// Для каждого вызывается X(имя, название в параметре --rng).
+	#define INT6502_RANDOM_KINDS(X) \
+		X(XORSHIFT, "xorshift") \
+		X(PCG,      "pcg")
+	
+	enum class RandomKind : uint8_t {
+		#define RANDOM_KIND_ENUM(name, option) name,
+		INT6502_RANDOM_KINDS(RANDOM_KIND_ENUM)
+		#undef RANDOM_KIND_ENUM
+	};
+	
+	// Ищет генератор по названию. Возвращает false, если такого нет
+	extern bool parseRandomKind(const char* name, RandomKind& kind);
+	
+	
+	// Генератор случайных чисел. Всё его состояние хранится в структуре,
+	// поэтому одно и то же начальное значение даёт одну и ту же последовательность.
+	struct Random {
+		uint64_t state;
+		RandomKind kind;
+		
+		// Инициализирует состояние из начального значения seed
+		void seed(uint64_t seed, RandomKind kind = RandomKind::XORSHIFT);
+		
+		// Возвращает следующий байт последовательности
+		inline uint8_t next() {
+			if (kind == RandomKind::PCG) {
+				// PCG-XSH-RR 64/32
+				const uint64_t old = state;
+				state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+				
+				const uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+				const uint32_t rot = uint32_t(old >> 59);
+				return uint8_t(((xorshifted >> rot) | (xorshifted << ((32 - rot) & 31))) >> 24);
+			}
+			
+			// xorshift64*
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return uint8_t((state * 0x2545F4914F6CDD1DULL) >> 56);
+		}
+	};
+}
+
+#endif /* INT6502_RANDOM_H */
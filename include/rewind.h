@@ -0,0 +1,44 @@
+#ifndef INT6502_REWIND_H
+#define INT6502_REWIND_H
+
+#include "snapshot.h"
+#include <deque>
+#include <cstdint>
+
+namespace int6502 {
+	
+	class Machine;
+	
+	
+	// История состояний машины для перемотки назад. Снимки делаются каждые interval тактов,
+	// каждый относительно предыдущего, поэтому новые страницы памяти выделяются только под изменившиеся
+	// за интервал страницы, а остальные разделяются с предыдущим снимком. Расход памяти зависит
+	// от того, сколько страниц программа меняет, а не от длины истории.
+	class RewindBuffer {
+		std::deque<Snapshot> history;
+		const uint64_t interval;
+		const size_t depth;
+		uint64_t nextCycles = 0;
+	
+	public:
+		// interval - тактов между снимками, depth - сколько последних снимков хранится
+		RewindBuffer(uint64_t interval, size_t depth);
+		
+		RewindBuffer(const RewindBuffer&) = delete;
+		
+		// Делает снимок, если с предыдущего прошло не меньше interval тактов.
+		// Вызывается между шагами выполнения
+		void record(const Machine& machine);
+		
+		// Восстанавливает в machine последний снимок и убирает его из истории,
+		// так что следующий вызов вернётся ещё на interval тактов назад (самый старый снимок остаётся).
+		// Возвращает false, если история пуста.
+		bool stepBack(Machine& machine);
+		
+		inline size_t size() const {
+			return history.size();
+		}
+	};
+}
+
+#endif /* INT6502_REWIND_H */
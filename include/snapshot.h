@@ -0,0 +1,61 @@
+#ifndef INT6502_SNAPSHOT_H
+#define INT6502_SNAPSHOT_H
+
+#include "executor.h"
+#include "insn.h"
+#include <array>
+#include <memory>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Снимок полного состояния машины: памяти (вместе с ячейкой нажатой клавиши INPUT_POS),
+	// регистров, флагов, счётчиков и состояния генератора случайных чисел.
+	// Память хранится неизменяемыми страницами по 256 байт, которые разделяются между снимками:
+	// копирование снимка не копирует память, а снимок, сделанный относительно предыдущего,
+	// копирует только изменившиеся страницы. Поэтому один снимок можно одновременно
+	// восстанавливать в машинах разных потоков.
+	class Snapshot {
+	public:
+		static const size_t
+				PAGE_SIZE = 0x100,
+				PAGES = MEM_SIZE / PAGE_SIZE;
+		
+		using Page = std::array<uint8_t, PAGE_SIZE>;
+	
+	private:
+		processor_state state;
+		std::shared_ptr<const Page> pages[PAGES];
+	
+	public:
+		// Пустой снимок: нулевая память и состояние процессора при запуске
+		Snapshot();
+		
+		// Снимок памяти mem (MEM_SIZE байт) и состояния state. Если base не NULL,
+		// страницы, не изменившиеся с base, разделяются с ним, а не копируются
+		Snapshot(const uint8_t* mem, const processor_state& state, const Snapshot* base = nullptr);
+		
+		inline const processor_state& getState() const {
+			return state;
+		}
+		
+		inline const Page& getPage(size_t index) const {
+			return *pages[index];
+		}
+		
+		// Копирует память снимка в mem (MEM_SIZE байт)
+		void copyMemory(uint8_t* mem) const;
+		
+		// Записывает снимок в файл. Нулевые страницы не записываются.
+		// Возвращает 0 в случае успеха, иначе код ошибки.
+		int save(const char* filename) const;
+		
+		// Читает снимок из файла. Возвращает 0 в случае успеха, иначе код ошибки.
+		int load(const char* filename);
+		
+		// Возвращает true, если файл начинается с заголовка снимка
+		static bool isSnapshotFile(const char* filename);
+	};
+}
+
+#endif /* INT6502_SNAPSHOT_H */
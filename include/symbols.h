@@ -0,0 +1,89 @@
+#ifndef INT6502_SYMBOLS_H
+#define INT6502_SYMBOLS_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Номер строки в таблице символов. Одинаковые строки получают один и тот же номер,
+	// поэтому символы сравниваются как числа
+	using Symbol = uint32_t;
+	
+	
+	// Таблица символов ассемблера, общая для лейблов, define-ов и ссылок на лейблы.
+	// Строки копируются один раз в арену (с завершающим нулём) и ищутся в хеш-таблице
+	// с открытой адресацией, поэтому повторные имена и числа не выделяют память.
+	class SymbolTable {
+	public:
+		static const size_t NO_LABEL = SIZE_MAX;
+	
+	private:
+		struct Entry {
+			const char* name;
+			uint32_t length;
+			uint32_t hash;
+			Symbol value;      // Значение define или сам символ
+			size_t label;      // Смещение лейбла относительно начала кода или NO_LABEL
+			bool isLabelName;  // Строка - допустимое имя лейбла
+		};
+		
+		std::vector<Entry> entries;
+		std::vector<Symbol> slots; // Номер символа + 1, 0 - пустой слот. Размер - степень двойки
+		
+		std::vector<std::unique_ptr<char[]>> chunks;
+		char* chunkPos = nullptr;
+		size_t chunkLeft = 0;
+		
+		const char* store(const char* str, size_t length);
+		void grow();
+	
+	public:
+		SymbolTable();
+		
+		SymbolTable(const SymbolTable&) = delete;
+		
+		// Возвращает символ для строки str длины length, добавляя его при первой встрече
+		Symbol intern(const char* str, size_t length);
+		
+		// Возвращает строку символа (с завершающим нулём)
+		inline const char* getName(Symbol symbol) const {
+			return entries[symbol].name;
+		}
+		
+		inline size_t getLength(Symbol symbol) const {
+			return entries[symbol].length;
+		}
+		
+		inline bool isLabelName(Symbol symbol) const {
+			return entries[symbol].isLabelName;
+		}
+		
+		// Возвращает значение define или сам символ, если он не определён
+		inline Symbol resolve(Symbol symbol) const {
+			return entries[symbol].value;
+		}
+		
+		inline void define(Symbol name, Symbol value) {
+			entries[name].value = value;
+		}
+		
+		inline void setLabel(Symbol name, size_t offset) {
+			entries[name].label = offset;
+		}
+		
+		// Возвращает смещение лейбла или NO_LABEL
+		inline size_t getLabel(Symbol name) const {
+			return entries[name].label;
+		}
+		
+		// Количество символов. Символы нумеруются с 0
+		inline size_t size() const {
+			return entries.size();
+		}
+	};
+}
+
+#endif /* INT6502_SYMBOLS_H */
@@ -0,0 +1,64 @@
+#ifndef INT6502_THREAD_POOL_H
+#define INT6502_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace int6502 {
+	
+	// Пул потоков с перехватом задач (work stealing). У каждого потока своя очередь:
+	// поток берёт задачи с её начала в порядке добавления, а когда она пуста - с конца очереди другого потока.
+	// Так потоки не конкурируют за одну очередь, долгие задачи не задерживают остальные,
+	// а задачи в целом выполняются примерно в порядке добавления.
+	class ThreadPool {
+	public:
+		using Task = std::function<void()>;
+	
+	private:
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+		
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> threads;
+		
+		std::atomic<size_t> queued;     // Задачи, которые ещё не взял ни один поток
+		std::atomic<size_t> unfinished; // Задачи, которые ещё не завершились
+		std::atomic<size_t> nextQueue;  // Очередь для следующей задачи
+		bool stopping = false;
+		
+		std::mutex mutex;
+		std::condition_variable hasWork;
+		std::condition_variable done;
+		
+		void work(size_t index);
+		bool take(size_t index, Task& task);
+	
+	public:
+		// threads - количество потоков, 0 - по количеству ядер
+		explicit ThreadPool(unsigned threads = 0);
+		
+		// Дожидается завершения всех задач
+		~ThreadPool();
+		
+		ThreadPool(const ThreadPool&) = delete;
+		
+		void submit(Task task);
+		
+		// Дожидается завершения всех добавленных задач
+		void wait();
+		
+		inline size_t size() const {
+			return threads.size();
+		}
+	};
+}
+
+#endif /* INT6502_THREAD_POOL_H */
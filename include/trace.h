@@ -0,0 +1,89 @@
+#ifndef INT6502_TRACE_H
+#define INT6502_TRACE_H
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+namespace int6502 {
+	
+	// Запись трассы: состояние процессора перед выполнением инструкции
+	struct TraceRecord {
+		uint32_t cycles;    // Младшие 32 бита счётчика тактов
+		uint16_t pc;
+		uint8_t opcode;
+		uint8_t operand[2]; // Байты после опкода (используются не все)
+		uint8_t a, x, y, sp, flags;
+		uint8_t reserved[2];
+	};
+	
+	static_assert(sizeof(TraceRecord) == 16, "Trace record must be 16 bytes");
+	
+	
+	// Заголовок файла трассы. За ним следуют count записей от самой старой к самой новой.
+	// Все числа записываются в порядке байт машины (little-endian на x86)
+	struct TraceHeader {
+		char magic[8];       // TRACE_MAGIC
+		uint32_t version;    // TRACE_VERSION
+		uint32_t recordSize; // sizeof(TraceRecord)
+		uint64_t count;      // Количество записей в файле
+		uint64_t total;      // Количество инструкций, записанных за всё время (вместе с вытесненными)
+		uint64_t lastCycles; // Полный счётчик тактов последней записи
+	};
+	
+	static const char TRACE_MAGIC[8] = { 'I', '6', '5', '0', '2', 'T', 'R', 'C' };
+	static const uint32_t TRACE_VERSION = 1;
+	
+	
+	// Трасса выполнения в кольцевом буфере: хранятся последние capacity инструкций.
+	// Запись одной инструкции - несколько сохранений в память без ветвлений,
+	// поэтому трассировку можно не выключать и при обычных запусках.
+	// Буфер записывается в файл по окончании выполнения или при ошибке.
+	class Tracer {
+		std::vector<TraceRecord> records;
+		size_t mask;
+		uint64_t total = 0;
+		uint64_t lastCycles = 0;
+	
+	public:
+		static const size_t DEFAULT_CAPACITY = 1 << 20;
+		
+		// capacity округляется вверх до степени двойки
+		explicit Tracer(size_t capacity = DEFAULT_CAPACITY);
+		
+		Tracer(const Tracer&) = delete;
+		
+		// Вызывается перед выполнением каждой инструкции
+		inline void record(const uint8_t* mem, uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t sp, uint8_t flags, uint64_t cycles) {
+			TraceRecord& record = records[total++ & mask];
+			record.cycles = uint32_t(cycles);
+			record.pc = pc;
+			record.opcode = mem[pc];
+			record.operand[0] = mem[uint16_t(pc + 1)];
+			record.operand[1] = mem[uint16_t(pc + 2)];
+			record.a = a;
+			record.x = x;
+			record.y = y;
+			record.sp = sp;
+			record.flags = flags;
+			lastCycles = cycles;
+		}
+		
+		inline uint64_t getTotal() const {
+			return total;
+		}
+		
+		// Записывает трассу в файл. Возвращает 0 в случае успеха, иначе код ошибки.
+		int write(const char* filename) const;
+	};
+	
+	
+	// Читает файл трассы. Полные счётчики тактов записей восстанавливаются в cycles.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	int readTrace(const char* filename, TraceHeader& header, std::vector<TraceRecord>& records, std::vector<uint64_t>& cycles);
+	
+	// Выводит запись трассы в виде строки дизассемблированного листинга
+	void writeTraceRecord(FILE* out, const TraceRecord& record, uint64_t cycles);
+}
+
+#endif /* INT6502_TRACE_H */
@@ -2,12 +2,36 @@
 #define INT6502_TRANSLATOR_H
 
 #include <vector>
+#include <map>
+#include <string>
+#include <istream>
+#include <cstddef>
 #include <cstdint>
 
 namespace int6502 {
+	// Связь машинного кода с исходным: по ней адреса отображаются обратно в строки и лейблы
+	struct DebugInfo {
+		std::map<uint16_t, int> lines;          // Номер строки для адреса начала каждой инструкции
+		std::map<uint16_t, std::string> labels; // Лейблы по адресам (если на адрес указывает несколько, то первый по алфавиту)
+		
+		// Возвращает номер строки инструкции по адресу addr или 0
+		int getLine(uint16_t addr) const;
+		
+		// Возвращает "лейбл" или "лейбл+смещение" для ближайшего лейбла не выше addr или "$nnnn"
+		std::string getSymbol(uint16_t addr) const;
+	};
+	
+	
 	// Транслирует код из файла в машинный код. Результат записывается в 
-	// переменную code. Возвращает 0 в случае успеха, иначе код ошибки.
-	extern int translate(const char* filename, std::vector<uint8_t>& code);
+	// переменную code. Если debug не NULL, в него записывается связь кода с исходником.
+	// Возвращает 0 в случае успеха, иначе код ошибки.
+	extern int translate(const char* filename, std::vector<uint8_t>& code, DebugInfo* debug = nullptr);
+	
+	// То же, что и translate(filename, code), но читает код из потока source
+	extern int translate(std::istream& source, std::vector<uint8_t>& code, DebugInfo* debug = nullptr);
+	
+	// То же, что и translate(filename, code), но разбирает код прямо из буфера source длины size без копирования
+	extern int translate(const char* source, size_t size, std::vector<uint8_t>& code, DebugInfo* debug = nullptr);
 }
 
 #endif /* INT6502_TRANSLATOR_H */
@@ -2,6 +2,9 @@
 #define INT6502_UTIL_H
 
 #include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <algorithm>
 
@@ -50,15 +53,93 @@ namespace int6502 {
 	}
 	
 	
+	// То же, что и syntaxError, но выводит ещё и номер столбца (начиная с 1)
+	inline int syntaxErrorAt(int lineNum, int column, const char* fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		
+		fprintf(stderr, "Error at line %d, column %d: ", lineNum, column);
+		vfprintf(stderr, fmt, args);
+		fprintf(stderr, "\r\n");
+		
+		va_end(args);
+		return INVALID_SYNTAX_ERROR;
+	}
+	
+	
 	inline int invalidSyntaxError(int lineNum) {
 		return syntaxError(lineNum, "Invalid syntax");
 	}
 	
 	
-	inline bool isValidLabel(const std::string& label) {
-		return !label.empty() &&
+	inline bool isValidLabel(const char* label, size_t length) {
+		return length != 0 &&
 				(std::isalpha(label[0]) || label[0] == '_') &&
-				std::all_of(label.cbegin() + 1, label.cend(), [] (char c) { return std::isalpha(c) || std::isdigit(c) || c == '_'; });
+				std::all_of(label + 1, label + length, [] (char c) { return std::isalpha(c) || std::isdigit(c) || c == '_'; });
+	}
+	
+	inline bool isValidLabel(const std::string& label) {
+		return isValidLabel(label.data(), label.size());
+	}
+	
+	
+	// Разбирает десятичное число не больше max. Возвращает false, если строка - не число или число больше max
+	inline bool parseUInt(const char* str, uint64_t max, uint64_t& res) {
+		char* end;
+		res = strtoull(str, &end, 10);
+		return *end == '\0' && end != str && res <= max;
+	}
+	
+	
+	// FNV-1a, 64 бита
+	inline uint64_t hashBytes(const uint8_t* data, size_t size) {
+		uint64_t hash = 0xCBF29CE484222325;
+		
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ data[i]) * 0x100000001B3;
+		}
+		
+		return hash;
+	}
+	
+	
+	// Добавляет строку str в формате JSON
+	inline void appendJsonString(std::string& out, const char* str) {
+		out += '"';
+		
+		for (const char* s = str; *s != '\0'; s++) {
+			const char c = *s;
+			
+			if (c == '"' || c == '\\') {
+				out += '\\';
+				out += c;
+				
+			} else if (uint8_t(c) < 0x20) {
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+				out += buffer;
+				
+			} else {
+				out += c;
+			}
+		}
+		
+		out += '"';
+	}
+	
+	// Добавляет строку, отформатированную как в printf, любой длины
+	template<typename... Args>
+	inline void appendFormat(std::string& out, const char* fmt, Args... args) {
+		const int length = snprintf(nullptr, 0, fmt, args...);
+		
+		if (length <= 0) {
+			return;
+		}
+		
+		const size_t pos = out.size();
+		out.resize(pos + length + 1); // snprintf всегда дописывает '\0'
+		snprintf(&out[pos], length + 1, fmt, args...);
+		out.resize(pos + length);
 	}
 }
 
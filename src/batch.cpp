@@ -0,0 +1,284 @@
+#include "machine.h"
+#include "translator.h"
+#include "thread_pool.h"
+#include "insn.h"
+#include "error_codes.h"
+#include "util.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace int6502 {
+	using std::string;
+	using std::vector;
+	
+	
+	// Начальные значения генератора от first до last включительно
+	struct SeedRange {
+		uint32_t first, last;
+	};
+	
+	struct Options {
+		vector<const char*> filenames;
+		vector<SeedRange> seeds;      // Запуски перебираются по мере выполнения, а не заранее
+		const char* output = nullptr; // NULL - stdout
+		unsigned threads = 0;         // 0 - по количеству ядер
+		uint64_t maxCycles = 0;       // 0 - без ограничения
+		bool seeded = false;          // Начальные значения заданы явно
+		MachineOptions machine;
+	};
+	
+	
+	// Программа, оттранслированная (или снимок, прочитанный) один раз для всех запусков
+	struct Program {
+		const char* filename;
+		vector<uint8_t> code;
+		bool isSnapshot;
+		Snapshot snapshot;
+		int error;
+	};
+	
+	// Запуск одной программы с одним начальным значением генератора
+	struct Job {
+		const Program* program;
+		uint32_t seed;
+	};
+	
+	
+	// Выполняет задачу и возвращает строку JSONL с результатом
+	static string runJob(const Job& job, const Options& options) {
+		string line = "{\"program\":";
+		appendJsonString(line, job.program->filename);
+		appendFormat(line, ",\"seed\":%u", job.seed);
+		
+		if (job.program->error != EXIT_SUCCESS) {
+			appendFormat(line, ",\"status\":\"error\",\"error\":%d}\n", job.program->error);
+			return line;
+		}
+		
+		MachineOptions machineOptions = options.machine;
+		machineOptions.seed = job.seed;
+		
+		Machine machine(machineOptions);
+		
+		const auto start = std::chrono::steady_clock::now();
+		
+		int res = machine.load(job.program->code);
+		
+		// Все запуски снимка разделяют его память. Генератор инициализируется заново,
+		// только если начальные значения заданы явно, иначе продолжается сохранённая последовательность
+		if (res == EXIT_SUCCESS && job.program->isSnapshot) {
+			res = machine.restore(job.program->snapshot);
+			
+			if (options.seeded) {
+				machine.reseed(job.seed);
+			}
+		}
+		
+		if (res == EXIT_SUCCESS) {
+			res = options.maxCycles != 0 ? machine.runUntil(options.maxCycles) : machine.run();
+		}
+		
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		
+		const char* status = res != EXIT_SUCCESS ? "error" : machine.isStopped() ? "brk" : "limit";
+		const processor_state& state = machine.getState();
+		const uint8_t* mem = machine.getMemory();
+		
+		appendFormat(line, ",\"status\":\"%s\"", status);
+		
+		if (res != EXIT_SUCCESS) {
+			appendFormat(line, ",\"error\":%d", res);
+		}
+		
+		appendFormat(line, ",\"a\":%u,\"x\":%u,\"y\":%u,\"sp\":%u,\"pc\":%u,\"flags\":%u",
+				state.a, state.x, state.y, state.sp, state.pc, state.flags);
+		
+		appendFormat(line, ",\"insns\":%llu,\"cycles\":%llu,\"seconds\":%.6f",
+				(unsigned long long)state.insns, (unsigned long long)state.cycles, elapsed.count());
+		
+		appendFormat(line, ",\"hash\":{\"mem\":\"%016llx\",\"zp\":\"%016llx\",\"stack\":\"%016llx\",\"gpu\":\"%016llx\"}}\n",
+				(unsigned long long)hashBytes(mem, MEM_SIZE),
+				(unsigned long long)hashBytes(mem, STACK_POS),
+				(unsigned long long)hashBytes(mem + STACK_POS, GPU_POS - STACK_POS),
+				(unsigned long long)hashBytes(mem + GPU_POS, GPU_SIZE));
+		
+		return line;
+	}
+	
+	
+	// Записывает результаты в порядке задач, как только готовы все предыдущие.
+	// Хранит только результаты, ожидающие предыдущих, поэтому число задач не ограничено памятью
+	class OrderedWriter {
+		FILE* out;
+		const uint64_t window;
+		std::map<uint64_t, string> pending;
+		uint64_t next = 0;
+		std::mutex mutex;
+		std::condition_variable written;
+	
+	public:
+		// window - сколько задач может выполняться или ждать записи одновременно
+		OrderedWriter(FILE* out, uint64_t window):
+				out(out), window(window) {}
+		
+		void write(uint64_t index, string&& result) {
+			std::lock_guard<std::mutex> lock(mutex);
+			
+			pending.emplace(index, std::move(result));
+			
+			for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it), next++) {
+				fputs(it->second.c_str(), out);
+			}
+			
+			fflush(out);
+			written.notify_all();
+		}
+		
+		// Дожидается, пока задачу index можно будет добавить, не превышая window
+		void waitForSlot(uint64_t index) {
+			std::unique_lock<std::mutex> lock(mutex);
+			written.wait(lock, [this, index] { return index < next + window; });
+		}
+	};
+	
+	
+	// Сколько задач на поток добавляется заранее
+	static const uint64_t JOBS_PER_THREAD = 16;
+	
+	
+	int run(const Options& options) {
+		vector<Program> programs(options.filenames.size());
+		
+		for (size_t i = 0; i < programs.size(); i++) {
+			programs[i].filename = options.filenames[i];
+			programs[i].isSnapshot = Snapshot::isSnapshotFile(options.filenames[i]);
+			
+			programs[i].error = programs[i].isSnapshot ?
+					programs[i].snapshot.load(options.filenames[i]) :
+					translate(options.filenames[i], programs[i].code);
+		}
+		
+		FILE* out = stdout;
+		
+		if (options.output != nullptr) {
+			out = fopen(options.output, "w");
+			
+			if (out == nullptr) {
+				return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.output);
+			}
+		}
+		
+		{
+			ThreadPool pool(options.threads);
+			OrderedWriter writer(out, pool.size() * JOBS_PER_THREAD);
+			
+			uint64_t index = 0;
+			
+			for (const Program& program : programs) {
+				for (const SeedRange& range : options.seeds) {
+					for (uint64_t seed = range.first; seed <= range.last; seed++, index++) {
+						writer.waitForSlot(index);
+						
+						const Job job { &program, uint32_t(seed) };
+						pool.submit([&, job, index] { writer.write(index, runJob(job, options)); });
+					}
+				}
+			}
+			
+			pool.wait();
+		}
+		
+		if (out != stdout) {
+			fclose(out);
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	
+	// Разбирает аргументы командной строки. Возвращает 0 в случае успеха, иначе код ошибки.
+	int parseOptions(int argc, const char* args[], Options& options) {
+		for (int i = 1; i < argc; i++) {
+			const char* arg = args[i];
+			uint64_t value;
+			
+			if (strcmp(arg, "--jit") == 0) {
+				options.machine.jit = true;
+				
+			} else if (strcmp(arg, "--no-fusion") == 0) {
+				options.machine.fusion = false;
+				
+			} else if (strcmp(arg, "--threads") == 0) {
+				if (++i == argc || !parseUInt(args[i], 0xFFFF, value)) return ARGUMENTS_ERROR;
+				options.threads = unsigned(value);
+				
+			} else if (strcmp(arg, "--max-cycles") == 0) {
+				if (++i == argc || !parseUInt(args[i], UINT64_MAX, value)) return ARGUMENTS_ERROR;
+				options.maxCycles = value;
+				
+			} else if (strcmp(arg, "--seed") == 0) {
+				if (++i == argc || !parseUInt(args[i], UINT32_MAX, value)) return ARGUMENTS_ERROR;
+				options.seeds.push_back(SeedRange { uint32_t(value), uint32_t(value) });
+				
+			} else if (strcmp(arg, "--rng") == 0) {
+				if (++i == argc || !parseRandomKind(args[i], options.machine.random)) return ARGUMENTS_ERROR;
+				
+			} else if (strcmp(arg, "--seeds") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				// Диапазон first-last включительно
+				const char* dash = strchr(args[i], '-');
+				if (dash == nullptr) return ARGUMENTS_ERROR;
+				
+				uint64_t first, last;
+				string firstStr(args[i], dash);
+				
+				if (!parseUInt(firstStr.c_str(), UINT32_MAX, first) ||
+					!parseUInt(dash + 1, UINT32_MAX, last) || first > last) {
+					return ARGUMENTS_ERROR;
+				}
+				
+				options.seeds.push_back(SeedRange { uint32_t(first), uint32_t(last) });
+				
+			} else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.output = args[i];
+				
+			} else if (arg[0] == '-') {
+				return ARGUMENTS_ERROR;
+				
+			} else {
+				options.filenames.push_back(arg);
+			}
+		}
+		
+		options.seeded = !options.seeds.empty();
+		
+		if (options.seeds.empty()) {
+			const uint32_t seed = uint32_t(MachineOptions().seed);
+			options.seeds.push_back(SeedRange { seed, seed });
+		}
+		
+		return !options.filenames.empty() ? EXIT_SUCCESS : ARGUMENTS_ERROR;
+	}
+}
+
+
+int main(int argc, const char* args[]) {
+	using namespace int6502;
+	
+	Options options;
+	
+	if (parseOptions(argc, args, options) != EXIT_SUCCESS) {
+		return error(ARGUMENTS_ERROR, "Usage: %s [--jit] [--no-fusion] [--threads <n>] [--max-cycles <n>] "
+				"[--seed <n>]... [--seeds <first>-<last>] [--rng xorshift|pcg] [-o <output>] <file>...", args[0]);
+	}
+	
+	return run(options);
+}
@@ -0,0 +1,383 @@
+#include "machine.h"
+#include "translator.h"
+#include "input_log.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace int6502 {
+	using std::string;
+	using std::vector;
+	
+	
+	// Способ выполнения кода, скорость которого измеряется
+	struct Backend {
+		const char* name;
+		bool jit;
+		bool fusion;
+	};
+	
+	static const Backend BACKENDS[] = {
+		{ "interpreter", false, true  },
+		{ "no-fusion",   false, false },
+		{ "jit",         true,  true  },
+	};
+	
+	
+	// Программа, оттранслированная один раз для всех запусков
+	struct Program {
+		const char* filename;
+		const char* replayFilename; // NULL - без записи ввода
+		vector<uint8_t> code;
+		InputLog replay;
+		int error;
+	};
+	
+	
+	struct Options {
+		vector<Program> programs;
+		vector<const Backend*> backends; // Пусто - все поддерживаемые
+		const char* output = nullptr;    // NULL - stdout
+		unsigned warmup = 1;             // Запуски перед измерением, результат которых не учитывается
+		unsigned repeat = 5;             // Измеряемые запуски
+		unsigned translateLines = 0;     // Размер исходника для замера транслятора, 0 - без замера
+	};
+	
+	
+	// Результат одного запуска
+	struct Sample {
+		double seconds;
+		uint64_t insns;
+		uint64_t cycles;
+		uint64_t hash;
+	};
+	
+	
+	// Добавляет минимальное, медианное и максимальное время и возвращает медиану
+	static double appendSeconds(string& out, vector<double>& seconds) {
+		std::sort(seconds.begin(), seconds.end());
+		
+		const double median = seconds.size() % 2 != 0 ? seconds[seconds.size() / 2] :
+				(seconds[seconds.size() / 2 - 1] + seconds[seconds.size() / 2]) / 2;
+		
+		appendFormat(out, ",\"seconds\":{\"min\":%.6f,\"median\":%.6f,\"max\":%.6f}",
+				seconds.front(), median, seconds.back());
+		
+		return median;
+	}
+	
+	
+	// Генерирует исходник примерно из lines строк: блоки с циклами, переходами и всеми видами операндов
+	static string generateSource(unsigned lines) {
+		static const char* const HEADER =
+				"; Generated translator benchmark\n"
+				"define PTR   $10\n"
+				"define COUNT $12\n"
+				"define TABLE $2000\n"
+				"\n";
+		
+		static const char* const BLOCK =
+				"block_%u:\n"
+				"\tldx #$10 ; counter\n"
+				"loop_%u:\n"
+				"\tlda TABLE,x\n"
+				"\tsta (PTR),y\n"
+				"\tlda ( PTR , x )\n"
+				"\tadc #%u\n"
+				"\tsta $0300,X\n"
+				"\tldy COUNT\n"
+				"\tasl a\n"
+				"\tror COUNT, x\n"
+				"\tldx $20,y\n"
+				"\tcmp #$FF\n"
+				"\tdex\n"
+				"\tbne loop_%u\n"
+				"\tjsr block_0\n"
+				"\tjmp ($%04X)\n"
+				"table_%u: dcb $%02X, $FF, 0, 17, $a5, $5A, 255, $10, TABLE, COUNT\n"
+				"\n";
+		
+		const unsigned BLOCK_LINES = 18;
+		
+		string source = HEADER;
+		
+		for (unsigned i = 0; i * BLOCK_LINES < lines; i++) {
+			appendFormat(source, BLOCK, i, i, i % 256, i, 0x3000 + i, i, i % 256);
+		}
+		
+		return source;
+	}
+	
+	
+	// Измеряет скорость транслятора на сгенерированном исходнике и возвращает строку JSONL с результатом
+	static string measureTranslator(const Options& options, int& res) {
+		const string source = generateSource(options.translateLines);
+		const size_t lines = size_t(std::count(source.begin(), source.end(), '\n'));
+		
+		string line = "{\"program\":\"<generated>\",\"backend\":\"translator\"";
+		
+		vector<uint8_t> code;
+		vector<double> seconds;
+		
+		for (unsigned i = 0; i < options.warmup + options.repeat; i++) {
+			code.clear();
+			
+			const auto start = std::chrono::steady_clock::now();
+			const int translateRes = translate(source.data(), source.size(), code);
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			
+			if (translateRes != EXIT_SUCCESS) {
+				res = translateRes;
+				appendFormat(line, ",\"status\":\"error\",\"error\":%d}\n", translateRes);
+				return line;
+			}
+			
+			if (i >= options.warmup) {
+				seconds.push_back(elapsed.count());
+			}
+		}
+		
+		appendFormat(line, ",\"status\":\"ok\",\"warmup\":%u,\"repeat\":%u,\"lines\":%zu,\"bytes\":%zu",
+				options.warmup, options.repeat, lines, code.size());
+		
+		const double median = appendSeconds(line, seconds);
+		
+		appendFormat(line, ",\"lines_per_sec\":%.0f,\"ns_per_line\":%.1f}\n", lines / median, median * 1e9 / lines);
+		return line;
+	}
+	
+	
+	// Выполняет программу до BRK (или до конца записи ввода) на новой машине.
+	// Время загрузки кода не учитывается. Возвращает 0 в случае успеха, иначе код ошибки.
+	static int runOnce(const Program& program, const Backend& backend, Sample& sample) {
+		MachineOptions machineOptions;
+		machineOptions.jit = backend.jit;
+		machineOptions.fusion = backend.fusion;
+		
+		if (program.replayFilename != nullptr && program.replay.seeded) {
+			machineOptions.seed = program.replay.seed;
+			machineOptions.random = program.replay.random;
+		}
+		
+		Machine machine(machineOptions);
+		
+		int res = machine.load(program.code);
+		if (res != EXIT_SUCCESS) return res;
+		
+		const auto start = std::chrono::steady_clock::now();
+		
+		if (program.replayFilename == nullptr) {
+			res = machine.run();
+			
+		} else {
+			// Так же, как при воспроизведении в int6502: порции заканчиваются ровно на инструкциях,
+			// перед которыми нажимались клавиши
+			const vector<InputEvent>& events = program.replay.events;
+			size_t nextEvent = 0;
+			
+			while (res == EXIT_SUCCESS && !machine.isStopped()) {
+				const uint64_t insns = machine.getState().insns;
+				
+				for (; nextEvent < events.size() && events[nextEvent].insns <= insns; nextEvent++) {
+					machine.setInput(events[nextEvent].key);
+				}
+				
+				if (nextEvent == events.size() && (!program.replay.stopped || insns >= program.replay.stopInsns)) {
+					break;
+				}
+				
+				const uint64_t next = nextEvent < events.size() ? events[nextEvent].insns : program.replay.stopInsns;
+				res = machine.step(next - insns);
+			}
+		}
+		
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		
+		sample.seconds = elapsed.count();
+		sample.insns = machine.getState().insns;
+		sample.cycles = machine.getState().cycles;
+		sample.hash = hashBytes(machine.getMemory(), MEM_SIZE);
+		return res;
+	}
+	
+	
+	// Измеряет программу на одном способе выполнения и возвращает строку JSONL с результатом.
+	// Скорость считается по медиане времени запусков
+	static string measure(const Program& program, const Backend& backend, const Options& options, int& res) {
+		string line = "{\"program\":";
+		appendJsonString(line, program.filename);
+		appendFormat(line, ",\"backend\":\"%s\",\"dispatch\":\"%s\"", backend.name, backend.jit ? "jit" : getDispatchName());
+		
+		if (backend.jit && !Jit::isSupported()) {
+			line += ",\"status\":\"unsupported\"}\n";
+			return line;
+		}
+		
+		int runRes = program.error;
+		vector<Sample> samples;
+		
+		for (unsigned i = 0; runRes == EXIT_SUCCESS && i < options.warmup + options.repeat; i++) {
+			Sample sample;
+			runRes = runOnce(program, backend, sample);
+			
+			// Все запуски должны прийти в одно и то же состояние
+			if (runRes == EXIT_SUCCESS && !samples.empty() && (sample.insns != samples[0].insns || sample.hash != samples[0].hash)) {
+				runRes = error(INTERNAL_ERROR, "%s (%s): runs ended in different states", program.filename, backend.name);
+			}
+			
+			if (i >= options.warmup || samples.empty()) {
+				samples.push_back(sample);
+			}
+		}
+		
+		if (runRes != EXIT_SUCCESS) {
+			res = runRes;
+			appendFormat(line, ",\"status\":\"error\",\"error\":%d}\n", runRes);
+			return line;
+		}
+		
+		// Первый образец прогревочный, если прогрев был
+		if (options.warmup != 0) {
+			samples.erase(samples.begin());
+		}
+		
+		vector<double> seconds;
+		
+		for (const Sample& sample : samples) {
+			seconds.push_back(sample.seconds);
+		}
+		
+		const Sample& sample = samples[0];
+		
+		appendFormat(line, ",\"status\":\"ok\",\"warmup\":%u,\"repeat\":%u,\"insns\":%llu,\"cycles\":%llu",
+				options.warmup, options.repeat, (unsigned long long)sample.insns, (unsigned long long)sample.cycles);
+		
+		const double median = appendSeconds(line, seconds);
+		
+		appendFormat(line, ",\"insns_per_sec\":%.0f,\"cycles_per_sec\":%.0f,\"ns_per_insn\":%.3f",
+				sample.insns / median, sample.cycles / median, median * 1e9 / std::max<uint64_t>(sample.insns, 1));
+		
+		appendFormat(line, ",\"hash\":\"%016llx\"}\n", (unsigned long long)sample.hash);
+		return line;
+	}
+	
+	
+	int run(Options& options) {
+		for (Program& program : options.programs) {
+			program.error = translate(program.filename, program.code);
+			
+			if (program.error == EXIT_SUCCESS && program.replayFilename != nullptr) {
+				program.error = program.replay.load(program.replayFilename);
+			}
+		}
+		
+		if (options.backends.empty()) {
+			for (const Backend& backend : BACKENDS) {
+				if (!backend.jit || Jit::isSupported()) {
+					options.backends.push_back(&backend);
+				}
+			}
+		}
+		
+		FILE* out = stdout;
+		
+		if (options.output != nullptr) {
+			out = fopen(options.output, "w");
+			
+			if (out == nullptr) {
+				return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.output);
+			}
+		}
+		
+		int res = EXIT_SUCCESS;
+		
+		if (options.translateLines != 0) {
+			fputs(measureTranslator(options, res).c_str(), out);
+			fflush(out);
+		}
+		
+		// Программы выполняются по очереди в одном потоке, чтобы не мешать друг другу
+		for (const Program& program : options.programs) {
+			for (const Backend* backend : options.backends) {
+				fputs(measure(program, *backend, options, res).c_str(), out);
+				fflush(out);
+			}
+		}
+		
+		if (out != stdout) {
+			fclose(out);
+		}
+		
+		return res;
+	}
+	
+	
+	// Разбирает аргументы командной строки. Возвращает 0 в случае успеха, иначе код ошибки.
+	int parseOptions(int argc, const char* args[], Options& options) {
+		const char* replay = nullptr; // Запись ввода для следующей программы
+		
+		for (int i = 1; i < argc; i++) {
+			const char* arg = args[i];
+			uint64_t value;
+			
+			if (strcmp(arg, "--warmup") == 0) {
+				if (++i == argc || !parseUInt(args[i], 0xFFFF, value)) return ARGUMENTS_ERROR;
+				options.warmup = unsigned(value);
+				
+			} else if (strcmp(arg, "--repeat") == 0) {
+				if (++i == argc || !parseUInt(args[i], 0xFFFF, value) || value == 0) return ARGUMENTS_ERROR;
+				options.repeat = unsigned(value);
+				
+			} else if (strcmp(arg, "--translate") == 0) {
+				if (++i == argc || !parseUInt(args[i], 1000000, value) || value == 0) return ARGUMENTS_ERROR;
+				options.translateLines = unsigned(value);
+				
+			} else if (strcmp(arg, "--backend") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				const Backend* const end = std::end(BACKENDS);
+				const Backend* const backend = std::find_if(std::begin(BACKENDS), end,
+						[&] (const Backend& backend) { return strcmp(backend.name, args[i]) == 0; });
+				
+				if (backend == end) return ARGUMENTS_ERROR;
+				options.backends.push_back(backend);
+				
+			} else if (strcmp(arg, "--replay") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				replay = args[i];
+				
+			} else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.output = args[i];
+				
+			} else if (arg[0] == '-') {
+				return ARGUMENTS_ERROR;
+				
+			} else {
+				options.programs.push_back(Program { arg, replay, {}, {}, EXIT_SUCCESS });
+				replay = nullptr;
+			}
+		}
+		
+		return (!options.programs.empty() || options.translateLines != 0) && replay == nullptr ? EXIT_SUCCESS : ARGUMENTS_ERROR;
+	}
+}
+
+
+int main(int argc, const char* args[]) {
+	using namespace int6502;
+	
+	Options options;
+	
+	if (parseOptions(argc, args, options) != EXIT_SUCCESS) {
+		return error(ARGUMENTS_ERROR, "Usage: %s [--warmup <n>] [--repeat <n>] [--backend interpreter|no-fusion|jit]... "
+				"[--translate <lines>] [-o <output>] [--replay <input>] <file>...", args[0]);
+	}
+	
+	return run(options);
+}
@@ -0,0 +1,70 @@
+#include "bus.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace int6502 {
+	
+	Bus::Bus(uint8_t* mem): mem(mem) {
+		std::fill(std::begin(readPages), std::end(readPages), nullptr);
+		std::fill(std::begin(writePages), std::end(writePages), nullptr);
+	}
+	
+	
+	int Bus::map(Device* device, uint16_t first, uint16_t last, unsigned access) {
+		// Номер отображения хранится в байте, 0 занят под обычную память
+		if (mappings.size() >= 0xFF) {
+			return error(INTERNAL_ERROR, "Too many devices on the bus");
+		}
+		
+		if (first > last || (access & (READ | WRITE)) == 0) {
+			return error(INTERNAL_ERROR, "Invalid device mapping $%04X-$%04X", first, last);
+		}
+		
+		mappings.push_back(Mapping { device, first, last, access });
+		rebuild();
+		return EXIT_SUCCESS;
+	}
+	
+	void Bus::unmap(Device* device) {
+		mappings.erase(
+				std::remove_if(mappings.begin(), mappings.end(), [device] (const Mapping& mapping) { return mapping.device == device; }),
+				mappings.end());
+		
+		rebuild();
+	}
+	
+	
+	// Заполняет таблицы страниц заново. Вызывается редко, поэтому не оптимизируется
+	void Bus::rebuild() {
+		std::fill(std::begin(readPages), std::end(readPages), nullptr);
+		std::fill(std::begin(writePages), std::end(writePages), nullptr);
+		pages.clear();
+		
+		const auto getPage = [this] (Page** table, size_t index) {
+			if (table[index] == nullptr) {
+				pages.emplace_back(new Page);
+				memset(pages.back()->mappings, 0, sizeof(Page::mappings));
+				table[index] = pages.back().get();
+			}
+			
+			return table[index];
+		};
+		
+		for (size_t i = 0; i < mappings.size(); i++) {
+			const Mapping& mapping = mappings[i];
+			
+			for (uint32_t addr = mapping.first; addr <= mapping.last; addr++) {
+				if (mapping.access & READ) {
+					getPage(readPages, addr >> 8)->mappings[addr & 0xFF] = uint8_t(i + 1);
+				}
+				
+				if (mapping.access & WRITE) {
+					getPage(writePages, addr >> 8)->mappings[addr & 0xFF] = uint8_t(i + 1);
+				}
+			}
+		}
+	}
+}
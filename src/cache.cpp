@@ -0,0 +1,221 @@
+#include "cache.h"
+#include "mapped_file.h"
+#include "error_codes.h"
+#include "util.h"
+#include "translator_id.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define HAVE_MKSTEMP 1
+#else
+	#define HAVE_MKSTEMP 0
+#endif
+
+namespace int6502 {
+	
+	using std::string;
+	using std::vector;
+	
+	
+	static const char CACHE_MAGIC[8] = { 'I', '6', '5', '0', '2', 'A', 'S', 'M' };
+	
+	// Увеличивается при изменении формата файла
+	static const uint32_t CACHE_VERSION = 2;
+	
+	// Хеш исходников транслятора, вычисляемый при сборке (cmake/translator_id.cmake).
+	// Кеш, записанный транслятором из других исходников, не читается
+	static const char TRANSLATOR_ID[] = INT6502_TRANSLATOR_ID;
+	
+	
+	// Числа в файле записываются в little-endian независимо от машины
+	static void put(vector<uint8_t>& out, uint64_t value, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			out.push_back(uint8_t(value >> (i * 8)));
+		}
+	}
+	
+	// Читает данные кеша, не выходя за их конец. После первого выхода за конец ok становится false
+	struct CacheReader {
+		const uint8_t* pos;
+		const uint8_t* const end;
+		bool ok = true;
+		
+		CacheReader(const uint8_t* data, size_t size):
+				pos(data), end(data + size) {}
+		
+		const uint8_t* skip(size_t size) {
+			if (!ok || size_t(end - pos) < size) {
+				ok = false;
+				return nullptr;
+			}
+			
+			const uint8_t* const res = pos;
+			pos += size;
+			return res;
+		}
+		
+		uint64_t get(size_t size) {
+			const uint8_t* in = skip(size);
+			uint64_t value = 0;
+			
+			for (size_t i = 0; in != nullptr && i < size; i++) {
+				value |= uint64_t(in[i]) << (i * 8);
+			}
+			
+			return value;
+		}
+	};
+	
+	
+	// Формат файла: заголовок с версией и идентификатором транслятора, размер и хеш исходника, машинный код,
+	// номера строк (адрес, строка) и лейблы (адрес, длина имени, имя)
+	static void saveCache(const char* filename, const string& path, uint64_t sourceSize, uint64_t sourceHash,
+			const vector<uint8_t>& code, const DebugInfo& debug) {
+				
+		vector<uint8_t> data(CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC));
+		put(data, CACHE_VERSION, 4);
+		data.insert(data.end(), TRANSLATOR_ID, TRANSLATOR_ID + sizeof(TRANSLATOR_ID) - 1);
+		put(data, sourceSize, 8);
+		put(data, sourceHash, 8);
+		
+		put(data, code.size(), 4);
+		data.insert(data.end(), code.begin(), code.end());
+		
+		put(data, debug.lines.size(), 4);
+		
+		for (const auto& line : debug.lines) {
+			put(data, line.first, 2);
+			put(data, uint32_t(line.second), 4);
+		}
+		
+		put(data, debug.labels.size(), 4);
+		
+		for (const auto& label : debug.labels) {
+			put(data, label.first, 2);
+			put(data, label.second.size(), 4);
+			data.insert(data.end(), label.second.begin(), label.second.end());
+		}
+		
+		// Файл записывается под уникальным временным именем в той же папке и переименовывается целиком,
+		// чтобы параллельный запуск не прочитал недописанный кеш и не писал в тот же временный файл
+		#if HAVE_MKSTEMP
+			string tempPath = path + ".XXXXXX";
+			
+			const int fd = mkstemp(&tempPath[0]);
+			if (fd < 0) return;
+			
+			// mkstemp создаёт файл, доступный только владельцу, а кеш читается теми же, кто читает исходник
+			struct stat sourceStat;
+			
+			if (stat(filename, &sourceStat) == 0) {
+				fchmod(fd, sourceStat.st_mode & 0666);
+			}
+			
+			FILE* file = fdopen(fd, "wb");
+			
+			if (file == nullptr) {
+				close(fd);
+				std::remove(tempPath.c_str());
+				return;
+			}
+			
+			bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+			ok = fclose(file) == 0 && ok;
+			
+			if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+				std::remove(tempPath.c_str());
+			}
+		#else
+			(void)filename;
+		#endif
+	}
+	
+	
+	// Возвращает true, если кеш прочитан и относится к исходнику с тем же размером и хешем
+	static bool loadCache(const string& path, uint64_t sourceSize, uint64_t sourceHash,
+			vector<uint8_t>& code, DebugInfo& debug) {
+				
+		MappedFile file;
+		if (file.open(path.c_str(), true) != EXIT_SUCCESS) return false;
+		
+		CacheReader in(file.getData(), file.getSize());
+		
+		const uint8_t* const magic = in.skip(sizeof(CACHE_MAGIC));
+		
+		if (magic == nullptr || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || in.get(4) != CACHE_VERSION) {
+			return false;
+		}
+		
+		const uint8_t* const translatorId = in.skip(sizeof(TRANSLATOR_ID) - 1);
+		
+		if (translatorId == nullptr || memcmp(translatorId, TRANSLATOR_ID, sizeof(TRANSLATOR_ID) - 1) != 0 ||
+			in.get(8) != sourceSize || in.get(8) != sourceHash) {
+			return false;
+		}
+		
+		const size_t codeSize = size_t(in.get(4));
+		const uint8_t* const codeData = in.skip(codeSize);
+		
+		DebugInfo loaded;
+		
+		for (size_t count = size_t(in.get(4)); in.ok && count > 0; count--) {
+			const uint16_t addr = uint16_t(in.get(2));
+			loaded.lines[addr] = int(in.get(4));
+		}
+		
+		for (size_t count = size_t(in.get(4)); in.ok && count > 0; count--) {
+			const uint16_t addr = uint16_t(in.get(2));
+			const size_t length = size_t(in.get(4));
+			const uint8_t* const name = in.skip(length);
+			
+			if (name != nullptr) {
+				loaded.labels[addr].assign(reinterpret_cast<const char*>(name), length);
+			}
+		}
+		
+		if (!in.ok || in.pos != in.end) {
+			return false;
+		}
+		
+		code.assign(codeData, codeData + codeSize);
+		debug = std::move(loaded);
+		return true;
+	}
+	
+	
+	string getCachePath(const char* filename) {
+		return string(filename) + ".cache";
+	}
+	
+	
+	int translateCached(const char* filename, vector<uint8_t>& code, DebugInfo& debug, CacheMode mode) {
+		MappedFile source;
+		
+		int res = source.open(filename);
+		if (res != EXIT_SUCCESS) return res;
+		
+		// Кешируются только обычные файлы: содержимое канала читается один раз и не повторяется
+		if (mode == CacheMode::DISABLED || !source.isMapped()) {
+			return translate(source.getChars(), source.getSize(), code, &debug);
+		}
+		
+		const string path = getCachePath(filename);
+		const uint64_t hash = hashBytes(source.getData(), source.getSize());
+		
+		if (mode == CacheMode::USE && loadCache(path, source.getSize(), hash, code, debug)) {
+			return EXIT_SUCCESS;
+		}
+		
+		res = translate(source.getChars(), source.getSize(), code, &debug);
+		
+		if (res == EXIT_SUCCESS) {
+			saveCache(filename, path, source.getSize(), hash, code, debug);
+		}
+		
+		return res;
+	}
+}
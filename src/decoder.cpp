@@ -0,0 +1,79 @@
+#include "decoder.h"
+#include "opcodes.h"
+#include <cstring>
+
+namespace int6502 {
+	
+	DecodedInsn decode(const uint8_t* mem, uint16_t pc) {
+		const uint8_t opcode = mem[pc];
+		const OpcodeInfo& info = getOpcodeInfo(opcode);
+		
+		const uint8_t lo = mem[uint16_t(pc + 1)];
+		const uint8_t hi = mem[uint16_t(pc + 2)];
+		
+		DecodedInsn insn;
+		insn.opcode = opcode;
+		insn.size = info.size;
+		insn.handler = opcode;
+		insn.operand2 = 0;
+		insn.count = 1;
+		insn.fusedSize = info.size;
+		insn.cycles = info.cycles;
+		insn.fusedCycles = info.cycles;
+		
+		switch (info.size) {
+			case 2:
+				insn.operand = info.mode == Addressing::REL ? uint16_t(pc + 2 + int8_t(lo)) : lo;
+				break;
+			
+			case 3:
+				insn.operand = uint16_t(lo | hi << 8);
+				break;
+			
+			default:
+				insn.operand = 0;
+				break;
+		}
+		
+		return insn;
+	}
+	
+	
+	DecodeCache::DecodeCache(bool fusion, uint16_t start):
+			fusion(fusion), start(start) {
+				
+		clear();
+		memset(fusionHits, 0, sizeof(fusionHits));
+	}
+	
+	void DecodeCache::fill(const uint8_t* mem, uint16_t pc, DecodedInsn& slot) {
+		slot = decode(mem, pc);
+		
+		if (fusion && slot.size != 0) {
+			fuse(mem, pc, slot);
+		}
+		
+		decodedPages[pc >> 8] = true;
+		decodedPages[uint16_t(pc + slot.fusedSize - 1) >> 8] = true;
+	}
+	
+	void DecodeCache::invalidate(uint16_t addr) {
+		// Инструкция или суперинструкция, в которую входит байт по адресу addr
+		for (int i = 0; i < MAX_FUSED_SIZE; i++) {
+			int pos = int(addr) - i;
+			
+			if (pos >= int(start)) {
+				slots[pos].size = 0;
+			}
+		}
+		
+		if (listener != nullptr) {
+			listener->onInvalidate(addr);
+		}
+	}
+	
+	void DecodeCache::clear() {
+		memset(slots, 0, sizeof(slots));
+		memset(decodedPages, 0, sizeof(decodedPages));
+	}
+}
@@ -1,10 +1,78 @@
 #include "drawer.h"
+#include <cstring>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <chrono>
-#include <thread>
 #include <ncurses.h>
 
 namespace int6502 {
-	volatile bool stopped = false;
+	FrameBuffer::FrameBuffer(): middle(2), awake(false), closed(false) {
+		memset(frames, 0, sizeof(frames));
+		
+		if (pipe(wakeFds) != 0) {
+			wakeFds[0] = wakeFds[1] = -1;
+			return;
+		}
+		
+		fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+		fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+	}
+	
+	FrameBuffer::~FrameBuffer() {
+		if (isOpen()) {
+			::close(wakeFds[0]);
+			::close(wakeFds[1]);
+		}
+	}
+	
+	bool FrameBuffer::isOpen() const {
+		return wakeFds[0] >= 0;
+	}
+	
+	void FrameBuffer::publish(const uint8_t* gpuMem) {
+		memcpy(frames[back].cells, gpuMem, sizeof(Frame::cells));
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+		wake();
+	}
+	
+	const Frame* FrameBuffer::acquire() {
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+			return NULL;
+		}
+		
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+		return &frames[front];
+	}
+	
+	void FrameBuffer::wake() {
+		// Пока поток отрисовки не прочитал канал, писать в него повторно не нужно
+		if (!awake.exchange(true)) {
+			const char byte = 0;
+			ssize_t res = write(wakeFds[1], &byte, 1);
+			(void)res;
+		}
+	}
+	
+	int FrameBuffer::getWakeFd() const {
+		return wakeFds[0];
+	}
+	
+	void FrameBuffer::clearWake() {
+		char buffer[16];
+		while (read(wakeFds[0], buffer, sizeof(buffer)) > 0);
+		
+		awake.store(false);
+	}
+	
+	void FrameBuffer::close() {
+		closed.store(true);
+		wake();
+	}
+	
+	bool FrameBuffer::isClosed() const {
+		return closed.load();
+	}
 	
 	
 	struct Color {
@@ -43,8 +111,6 @@ namespace int6502 {
 	
 	
 	
-	static const std::chrono::milliseconds INTERVAL(100);
-	
 	static const int
 			COLOR_ORANGE      = 0x8,
 			COLOR_BROWN       = 0x9,
@@ -129,7 +195,7 @@ namespace int6502 {
 	void drawBorder() {
 		const int startY = getStartY();
 		const int startX = getStartX();
-			
+		
 		chtype border = ' ' | COLOR_PAIR(COLOR_BORDER);
 		
 		move(startY, startX);
@@ -148,49 +214,143 @@ namespace int6502 {
 	}
 	
 	
-	void update(uint8_t* inputMem, uint8_t* gpuMem) {
+	// Состояние экрана, принадлежащее потоку отрисовки (одному вызову draw)
+	struct DrawerState {
+		Frame shown = {};       // Кадр, который сейчас отображается
+		bool repaintAll = true; // Если true, при следующем обновлении перерисовываются все ячейки
+	};
+	
+	
+	// Отображает последний опубликованный кадр. Возвращает false, если отображать нечего
+	bool repaint(DrawerState& state, FrameBuffer& frames) {
 		const int startY = getStartY();
 		const int startX = getStartX();
 		
-		for (int y = 0; y < HEIGHT; ++y) {
-			move(startY + y + 1, startX + 2);
+		const Frame* frame = frames.acquire();
+		
+		if (frame == NULL && state.repaintAll) {
+			frame = &state.shown;
+		}
+		
+		if (frame == NULL) {
+			return false;
+		}
+		
+		// Перерисовываются только ячейки, которые отличаются от отображаемого кадра
+		for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+			if (frame->cells[i] == state.shown.cells[i] && !state.repaintAll) continue;
 			
-			for (int x = 0; x < WIDTH; ++x) {
-				chtype c = ' ' | COLOR_PAIR(getColor(gpuMem[x + y * WIDTH]));
-				
-				addch(c);
-				addch(c);
-			}
+			state.shown.cells[i] = frame->cells[i];
+			
+			chtype c = ' ' | COLOR_PAIR(getColor(state.shown.cells[i]));
+			
+			mvaddch(startY + i / WIDTH + 1, startX + 2 + i % WIDTH * 2, c);
+			addch(c);
 		}
 		
+		state.repaintAll = false;
 		refresh();
+		return true;
+	}
+	
+	
+	// Обрабатывает все нажатые клавиши. Если rewind, Backspace и Enter управляют перемоткой,
+	// иначе передаются программе как обычные символы. Возвращает количество прочитанных символов
+	int readInput(DrawerState& state, InputMailbox& input, bool rewind) {
+		int count = 0;
 		
-		int ch = getch();
-		
-		switch (ch) {
-			case KEY_UP:    *inputMem = 'w'; break;
-			case KEY_LEFT:  *inputMem = 'a'; break;
-			case KEY_DOWN:  *inputMem = 's'; break;
-			case KEY_RIGHT: *inputMem = 'd'; break;
-			default:
-				if (ch >= 0x20 && ch <= 0x7F) {
-					*inputMem = uint8_t(ch);
+		for (int ch; (ch = getch()) != ERR; ++count) {
+			if (rewind) {
+				if (ch == KEY_BACKSPACE || ch == 0x7F || ch == '\b') {
+					input.postRewind();
+					continue;
+				}
+				
+				if (ch == KEY_ENTER || ch == '\n' || ch == '\r') {
+					input.postResume();
+					continue;
 				}
+			}
+			
+			switch (ch) {
+				case KEY_RESIZE:
+					clear();
+					drawBorder();
+					state.repaintAll = true;
+					break;
+				
+				case KEY_UP:    input.post('w'); break;
+				case KEY_LEFT:  input.post('a'); break;
+				case KEY_DOWN:  input.post('s'); break;
+				case KEY_RIGHT: input.post('d'); break;
+				case 0x1B:      input.postStop(); break; // Esc
+				default:
+					if (ch >= 0x20 && ch <= 0x7F) {
+						input.post(uint8_t(ch));
+					}
+			}
 		}
+		
+		return count;
 	}
 	
 	
-	void draw(uint8_t* inputMem, uint8_t* gpuMem) {
+	void draw(FrameBuffer* frames, InputMailbox* input, unsigned maxFps, bool rewind) {
+		using namespace std::chrono;
+		
+		const auto interval = duration_cast<steady_clock::duration>(duration<double>(1.0 / maxFps));
+		auto nextFrame = steady_clock::now();
+		auto nextInput = nextFrame;
+		
+		DrawerState state;
+		
 		nodelay(stdscr, true);
 		initColors();
 		drawBorder();
 		
-		while (!stopped) {
-			update(inputMem, gpuMem);
-			std::this_thread::sleep_for(INTERVAL);
+		while (!frames->isClosed()) {
+			const auto now = steady_clock::now();
+			
+			pollfd fds[2];
+			nfds_t count = 0;
+			int stdinIndex = -1;
+			
+			// Пока не прошёл интервал между кадрами, новые кадры не ждём
+			if (now >= nextFrame) {
+				fds[count++] = { frames->getWakeFd(), POLLIN, 0 };
+			}
+			
+			// Если stdin сообщил о готовности, но ничего не прочиталось (например, процесс
+			// работает в фоне), он опрашивается не чаще, чем перерисовывается экран
+			if (now >= nextInput) {
+				stdinIndex = int(count);
+				fds[count++] = { STDIN_FILENO, POLLIN, 0 };
+			}
+			
+			int timeout = -1;
+			
+			if (count < 2) {
+				const auto wakeup = count == 0 ? std::min(nextFrame, nextInput) : std::max(nextFrame, nextInput);
+				timeout = int(duration_cast<milliseconds>(wakeup - now).count()) + 1;
+			}
+			
+			poll(fds, count, timeout);
+			
+			if (readInput(state, *input, rewind) == 0 && stdinIndex >= 0 && fds[stdinIndex].revents != 0) {
+				nextInput = steady_clock::now() + interval;
+			}
+			
+			if (steady_clock::now() >= nextFrame) {
+				frames->clearWake();
+				
+				if (repaint(state, *frames)) {
+					nextFrame = steady_clock::now() + interval;
+				}
+			}
 		}
 		
-		update(inputMem, gpuMem);
+		frames->clearWake();
+		repaint(state, *frames);
 		nodelay(stdscr, false);
 	}
 }
@@ -1,9 +1,23 @@
 #include "executor.h"
 #include "insn.h"
+#include "decoder.h"
+#include "opcodes.h"
+#include "jit.h"
+#include "bus.h"
+#include "profiler.h"
+#include "trace.h"
+#include "rewind.h"
+#include "input_log.h"
+#include "machine.h"
 #include "drawer.h"
 #include "scroll.h"
 #include "error_codes.h"
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iterator>
+#include <memory>
 #include <vector>
 #include <thread>
 #include <ncurses.h>
@@ -13,510 +27,457 @@ namespace int6502 {
 	
 	using std::vector;
 	
-	static const size_t MEM_SIZE = 0x10000;
-	
-	static uint8_t SIZES[0x100] = {};
-	
-	static bool initSizes() {
-		SIZES[LDA_IMM]   = 2;
-		SIZES[LDA_ZP]    = 2;
-		SIZES[LDA_ZP_X]  = 2;
-		SIZES[LDA_ABS]   = 3;
-		SIZES[LDA_ABS_X] = 3;
-		SIZES[LDA_ABS_Y] = 3;
-		SIZES[LDA_IND_X] = 2;
-		SIZES[LDA_IND_Y] = 2;
-		
-		SIZES[LDX_IMM]   = 2;
-		SIZES[LDX_ZP]    = 2;
-		SIZES[LDX_ZP_Y]  = 2;
-		SIZES[LDX_ABS]   = 3;
-		SIZES[LDX_ABS_Y] = 3;
-		
-		SIZES[LDY_IMM]   = 2;
-		SIZES[LDY_ZP]    = 2;
-		SIZES[LDY_ZP_X]  = 2;
-		SIZES[LDY_ABS]   = 3;
-		SIZES[LDY_ABS_X] = 3;
-		
-		SIZES[STA_ZP]    = 2;
-		SIZES[STA_ZP_X]  = 2;
-		SIZES[STA_ABS]   = 3;
-		SIZES[STA_ABS_X] = 3;
-		SIZES[STA_ABS_Y] = 3;
-		SIZES[STA_IND_X] = 2;
-		SIZES[STA_IND_Y] = 2;
-		
-		SIZES[STX_ZP]    = 2;
-		SIZES[STX_ZP_Y]  = 2;
-		SIZES[STX_ABS]   = 3;
-		
-		SIZES[STY_ZP]    = 2;
-		SIZES[STY_ZP_X]  = 2;
-		SIZES[STY_ABS]   = 3;
-		
-		SIZES[CMP_IMM]   = 2;
-		SIZES[CMP_ZP]    = 2;
-		SIZES[CMP_ZP_X]  = 2;
-		SIZES[CMP_ABS]   = 3;
-		SIZES[CMP_ABS_X] = 3;
-		SIZES[CMP_ABS_Y] = 3;
-		SIZES[CMP_IND_X] = 2;
-		SIZES[CMP_IND_Y] = 2;
-		
-		SIZES[CPX_IMM]   = 2;
-		SIZES[CPX_ZP]    = 2;
-		SIZES[CPX_ABS]   = 3;
-		
-		SIZES[CPY_IMM]   = 2;
-		SIZES[CPY_ZP]    = 2;
-		SIZES[CPY_ABS]   = 3;
-		
-		SIZES[BIT_ZP]    = 2;
-		SIZES[BIT_ABS]   = 3;
-		
-		SIZES[AND_IMM]   = 2;
-		SIZES[AND_ZP]    = 2;
-		SIZES[AND_ZP_X]  = 2;
-		SIZES[AND_ABS]   = 3;
-		SIZES[AND_ABS_X] = 3;
-		SIZES[AND_ABS_Y] = 3;
-		SIZES[AND_IND_X] = 2;
-		SIZES[AND_IND_Y] = 2;
-
-		SIZES[ORA_IMM]   = 2;
-		SIZES[ORA_ZP]    = 2;
-		SIZES[ORA_ZP_X]  = 2;
-		SIZES[ORA_ABS]   = 3;
-		SIZES[ORA_ABS_X] = 3;
-		SIZES[ORA_ABS_Y] = 3;
-		SIZES[ORA_IND_X] = 2;
-		SIZES[ORA_IND_Y] = 2;
-		
-		SIZES[EOR_IMM]   = 2;
-		SIZES[EOR_ZP]    = 2;
-		SIZES[EOR_ZP_X]  = 2;
-		SIZES[EOR_ABS]   = 3;
-		SIZES[EOR_ABS_X] = 3;
-		SIZES[EOR_ABS_Y] = 3;
-		SIZES[EOR_IND_X] = 2;
-		SIZES[EOR_IND_Y] = 2;
-
-		SIZES[ADC_IMM]   = 2;		
-		SIZES[ADC_ZP]    = 2;
-		SIZES[ADC_ZP_X]  = 2;
-		SIZES[ADC_ABS]   = 3;
-		SIZES[ADC_ABS_X] = 3;
-		SIZES[ADC_ABS_Y] = 3;
-		SIZES[ADC_IND_X] = 2;
-		SIZES[ADC_IND_Y] = 2;
-		
-		SIZES[SBC_IMM]   = 2;
-		SIZES[SBC_ZP]    = 2;
-		SIZES[SBC_ZP_X]  = 2;
-		SIZES[SBC_ABS]   = 3;
-		SIZES[SBC_ABS_X] = 3;
-		SIZES[SBC_ABS_Y] = 3;
-		SIZES[SBC_IND_X] = 2;
-		SIZES[SBC_IND_Y] = 2;
-
-		SIZES[ASL_A]     = 1;
-		SIZES[ASL_ZP]    = 2;
-		SIZES[ASL_ZP_X]  = 2;
-		SIZES[ASL_ABS]   = 3;
-		SIZES[ASL_ABS_X] = 3;
-		
-		SIZES[LSR_A]     = 1;
-		SIZES[LSR_ZP]    = 2;
-		SIZES[LSR_ZP_X]  = 2;
-		SIZES[LSR_ABS]   = 3;
-		SIZES[LSR_ABS_X] = 3;
-		
-		SIZES[ROL_A]     = 1;
-		SIZES[ROL_ZP]    = 2;
-		SIZES[ROL_ZP_X]  = 2;
-		SIZES[ROL_ABS]   = 3;
-		SIZES[ROL_ABS_X] = 3;
-		
-		SIZES[ROR_A]     = 1;
-		SIZES[ROR_ZP]    = 2;
-		SIZES[ROR_ZP_X]  = 2;
-		SIZES[ROR_ABS]   = 3;
-		SIZES[ROR_ABS_X] = 3;
-		
-		SIZES[INC_ZP]    = 2;
-		SIZES[INC_ZP_X]  = 2;
-		SIZES[INC_ABS]   = 3;
-		SIZES[INC_ABS_X] = 3;
-		
-		SIZES[DEC_ZP]    = 2;
-		SIZES[DEC_ZP_X]  = 2;
-		SIZES[DEC_ABS]   = 3;
-		SIZES[DEC_ABS_X] = 3;
-		
-		SIZES[INX]       = 1;
-		SIZES[INY]       = 1;
-		SIZES[DEX]       = 1;
-		SIZES[DEY]       = 1;
-
-		SIZES[CLC]       = 1;
-		SIZES[CLI]       = 1;
-		SIZES[CLD]       = 1;
-		SIZES[CLV]       = 1;
-		SIZES[SEC]       = 1;
-		SIZES[SEI]       = 1;
-		SIZES[SED]       = 1;
-		
-		SIZES[TAX]       = 1;
-		SIZES[TXA]       = 1;
-		SIZES[TAY]       = 1;
-		SIZES[TYA]       = 1;
-		SIZES[TSX]       = 1;
-		SIZES[TXS]       = 1;
-		
-		SIZES[PHA]       = 1;
-		SIZES[PHP]       = 1;
-		SIZES[PLA]       = 1;
-		SIZES[PLP]       = 1;
-
-		SIZES[NOP]       = 1;
-		
-		SIZES[BEQ]       = 2;
-		SIZES[BNE]       = 2;
-		SIZES[BMI]       = 2;
-		SIZES[BPL]       = 2;
-		SIZES[BCS]       = 2;
-		SIZES[BCC]       = 2;
-		SIZES[BVS]       = 2;
-		SIZES[BVC]       = 2;
-
-		SIZES[JMP_ABS]   = 3;
-		SIZES[JMP_IND]   = 2;
-		
-		SIZES[JSR]       = 3;
-		SIZES[RTS]       = 1;
-		
-		SIZES[BRK]       = 1;
-		SIZES[RTI]       = 1;
-		
-		return true;
-	}
 	
+	// Диспетчеризация через computed goto (labels as values) доступна только в GCC и Clang.
+	// В остальных компиляторах используется обычный switch.
+	#if defined(INT6502_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+		#define THREADED_DISPATCH 1
+	#else
+		#define THREADED_DISPATCH 0
+	#endif
 	
-	struct processor_state {
-		uint8_t a, x, y, sp;
-		uint16_t pc;
-		uint8_t flags;
-	};
 	
-	// mem - память, аллоцированная для ассемблера
-	// state - указатель на итоговое состояние процессора
-	int run(uint8_t* mem, processor_state* state) {
-		{
-			static bool unused = initSizes();
-			(void)unused;
-		}
+	#if THREADED_DISPATCH
+		#pragma GCC diagnostic push
+		#pragma GCC diagnostic ignored "-Wpedantic" // &&label и goto *ptr
+	#endif
+	
+	int run(Bus& bus, DecodeCache& cache, processor_state* state, uint64_t limit, Profiler* profiler, Tracer* tracer) {
+		uint8_t* const mem = bus.getMemory();
+		uint8_t a = state->a, x = state->x, y = state->y, sp = state->sp;
+		uint16_t pc = state->pc;
+		uint64_t remaining = limit;
+		uint64_t cycles = state->cycles;
+		int res = EXIT_SUCCESS;
+		
+		bool V = FLAG_V(state->flags), // overflow
+			 B = FLAG_B(state->flags), // break
+			 D = FLAG_D(state->flags), // BCD mode
+			 I = FLAG_I(state->flags); // no interrupt
+		
+		// Флаги N, Z и C вычисляются лениво, только когда их читают.
+		// nz - последний результат: Z = (nz & 0xFF) == 0, N = (nz & 0x8080) != 0
+		// (старший байт нужен только для BIT, где N и Z независимы).
+		// cw - слово переноса: C = бит 8.
+		uint16_t nz, cw;
+		
+		#define N_FLAG ((nz & 0x8080) != 0)
+		#define Z_FLAG ((nz & 0xFF) == 0)
+		#define C_FLAG ((cw >> 8) & 1)
+		
+		#define UNPACK_NZC(flags) \
+				nz = uint16_t(FLAG_Z(flags) ? FLAG_N(flags) << 15 : (FLAG_N(flags) ? 0x80 : 1)); \
+				cw = uint16_t(FLAG_C(flags) << 8);
+		
+		UNPACK_NZC(state->flags);
+		
+		
+		#define get16(addr, off) uint16_t((mem[addr] | (mem[addr+1] << 8)) + off)
+		
+		// Адреса операндов. op - операнд, разрешённый декодером
+		#define aZP   op
+		#define aZPX  uint8_t(op+x)
+		#define aZPY  uint8_t(op+y)
+		#define aABS  op
+		#define aABSX uint16_t(op+x)
+		#define aABSY uint16_t(op+y)
+		#define aINDX (ptr = uint8_t(op+x), get16(ptr,0))
+		#define aINDY (ptr = uint8_t(op),   get16(ptr,y))
+		
+		// Операнды читаются и записываются через шину: обычная память без вызовов, устройства - через их обработчики
+		#define READ(addr) (ea = (addr), bus.read(ea))
+		
+		#define imm  uint8_t(op)
+		#define zp   READ(aZP)
+		#define zpX  READ(aZPX)
+		#define zpY  READ(aZPY)
+		#define abs  READ(aABS)
+		// При чтении с индексом пересечение границы страницы стоит один такт
+		#define PAGE_CROSS(base, addr) (cycles += ((base) ^ (addr)) > 0xFF)
+		
+		#define absX READ((ea = aABSX, PAGE_CROSS(op, ea), ea))
+		#define absY READ((ea = aABSY, PAGE_CROSS(op, ea), ea))
+		#define indX READ(aINDX)
+		#define indY READ((ptr = uint8_t(op), u16 = get16(ptr, 0), ea = uint16_t(u16 + y), PAGE_CROSS(u16, ea), ea))
+		
+		#define STORE(addr, val) ea = addr; bus.write(ea, val); cache.onWrite(ea);
+		
+		
+		#define setNZ(val) (nz = uint8_t(val))
+		#define setV(op1, op2, val) (V =\
+				(int16_t(op1) & 0x8000) == (int16_t(op2) & 0x8000) &&\
+				(int16_t(op1) & 0x8000) != (int16_t(val) & 0x8000))
+		
+		
+		#define LOAD(reg, val) reg = val; setNZ(reg);
+		#define CMP(reg, val) s16 = int16_t(reg - val); setNZ(s16); cw = uint16_t(s16 + 0x100);
+		#define AND(val) a &= val; setNZ(a);
+		#define ORA(val) a |= val; setNZ(a);
+		#define EOR(val) a ^= val; setNZ(a);
+		#define ADC(val) u8 = val; u16 = uint16_t(a) + uint16_t(u8) +  C_FLAG; setNZ(u16); cw = u16;                  setV(a, +int16_t(u8), u16); a = uint8_t(u16);
+		#define SBC(val) u8 = val; s16 =  int16_t(a) -  int16_t(u8) - !C_FLAG; setNZ(s16); cw = uint16_t(s16 + 0x100); setV(a, -int16_t(u8), s16); a = uint8_t(s16);
+		
+		// Операции над регистром или переменной reg
+		#define ASL(reg) cw = uint16_t(reg << 1); reg <<= 1; setNZ(reg);
+		#define LSR(reg) cw = uint16_t(reg << 8); reg >>= 1; setNZ(reg);
+		
+		#define ROL(reg) u16 = uint16_t(reg << 1 | C_FLAG); cw = u16;               reg = uint8_t(u16);      setNZ(reg);
+		#define ROR(reg) u16 = uint16_t(reg | C_FLAG << 8); cw = uint16_t(u16 << 8); reg = uint8_t(u16 >> 1); setNZ(reg);
+		
+		#define INC(reg) ++reg; setNZ(reg);
+		#define DEC(reg) --reg; setNZ(reg);
+		
+		// Чтение-модификация-запись ячейки памяти
+		#define RMW(addr, OP) u8 = READ(addr); OP(u8); STORE(ea, u8);
+		
+		#define PUSH(val) (mem[STACK_POS + sp--] = uint8_t(val))
+		#define PULL() mem[STACK_POS + ++sp]
+		
+		#define PACK_FLAGS() uint8_t(N_FLAG << 7 | V << 6 | 1 << 5 | B << 4 | D << 3 | I << 2 | Z_FLAG << 1 | C_FLAG)
+		
+		
+		// Профилировщик вызывается, только если он собран, иначе вызовы полностью убираются
+		#ifdef INT6502_PROFILER
+			#define PROFILE_STEP()  if (profiler != NULL) profiler->step(pc, insn.opcode, cycles);
+			#define PROFILE_FLUSH() if (profiler != NULL) profiler->flush(pc, cycles);
+		#else
+			#define PROFILE_STEP()
+			#define PROFILE_FLUSH()
+			(void)profiler;
+		#endif
+		
+		// Трассировка включается без пересборки, поэтому проверяется при каждой инструкции
+		#define TRACE_STEP() if (tracer != NULL) tracer->record(mem, pc, a, x, y, sp, PACK_FLAGS(), cycles);
+		
+		// Суперинструкция выполняется, только если все её инструкции укладываются в limit,
+		// иначе выполняется только первая инструкция
+		#define FETCH() \
+				insn = cache.fetch(mem, pc); \
+				PROFILE_STEP(); \
+				TRACE_STEP(); \
+				if (insn.count > remaining) { \
+					insn.handler = insn.opcode; \
+					insn.count = 1; \
+					insn.fusedCycles = insn.cycles; \
+				} \
+				remaining -= insn.count; \
+				cycles += insn.fusedCycles; \
+				op = insn.operand;
+		
+		// Каждый обработчик заканчивается одним из макросов:
+		// NEXT() - переход к следующей инструкции
+		// NEXT_OR_STOP() - то же самое, но с остановкой, если установлен флаг B
+		// FUSED_NEXT() - переход к инструкции после суперинструкции
+		// JUMP(addr) - переход по адресу addr
+		// BRANCH(addr, next) - выполненный условный переход (next - адрес следующей инструкции)
+		#if THREADED_DISPATCH
+			#define HANDLER(opcode) L_##opcode:
+			#define FUSED_HANDLER(name) L_FUSION_##name: cache.onFusion(insn.handler);
+			#define UNKNOWN_HANDLER L_UNKNOWN:
+			
+			#define DISPATCH() \
+					if (remaining == 0) goto stop; \
+					FETCH(); \
+					goto *handlers[insn.handler];
+			
+			#define NEXT() pc += insn.size; DISPATCH()
+			#define NEXT_OR_STOP() pc += insn.size; if (B) goto stop; DISPATCH()
+			#define FUSED_NEXT() pc += insn.fusedSize; DISPATCH()
+			#define JUMP(addr) pc = addr; DISPATCH()
+		#else
+			#define HANDLER(opcode) case opcode:
+			#define FUSED_HANDLER(name) case FUSION_HANDLER + FUSION_##name: cache.onFusion(insn.handler);
+			#define UNKNOWN_HANDLER default:
 			
-		srand(time(NULL));
+			#define NEXT() break
+			#define NEXT_OR_STOP() break
+			#define FUSED_NEXT() pc += insn.fusedSize; continue
+			#define JUMP(addr) pc = addr; continue
+		#endif
 		
-		uint8_t a = 0, x = 0, y = 0, sp = 0xff;
-		uint16_t pc = CODE_POS;
 		
-		bool N = 0, // sign
-			 V = 0, // overflow
-			 B = 0, // break
-			 D = 0, // BCD mode
-			 I = 0, // no interrupt
-			 Z = 0, // zero
-			 C = 0; // carry
+		#define BRANCH(addr, next) cycles += 1 + ((uint16_t(next) ^ (addr)) > 0xFF); JUMP(addr)
 		
-		while (!B) {
-			mem[RND_POS] = uint8_t(rand());
-			
-			
-			#define imm mem[pc+1]
-			#define get16(addr, off) uint16_t((mem[addr] | (mem[addr+1] << 8)) + off)
-			
-			#define zp   mem[imm]
-			#define zpX  mem[uint8_t(imm+x)]
-			#define zpY  mem[uint8_t(imm+y)]
-			#define abs  mem[get16(pc+1,0)]
-			#define absX mem[get16(pc+1,x)]
-			#define absY mem[get16(pc+1,y)]
-			#define ind  (u8 = uint8_t(imm),   mem[get16(u8,0)])
-			#define indX (u8 = uint8_t(imm+x), mem[get16(u8,0)])
-			#define indY (u8 = uint8_t(imm),   mem[get16(u8,y)])
-			
-			
-			#define setN(val) (N = int8_t(val) < 0)
-			#define setZ(val) (Z = uint8_t(val) == 0)
-			#define setC(val, inv) (C = bool(val & 0x100) ^ bool(inv))
-			#define setV(op1, op2, val) (V =\
-					(int16_t(op1) & 0x8000) == (int16_t(op2) & 0x8000) &&\
-					(int16_t(op1) & 0x8000) != (int16_t(val) & 0x8000))
-			
-			#define setNZ(val) (setN(val), setZ(val))
-			
-			#define setNZVC(op1, op2, val, invC) (setN(val), setZ(val), setC(val, invC), setV(op1, op2, val))
-			
-			
-			#define LOAD(reg, val) reg = val; setNZ(reg);
-			#define CMP(reg, val) s16 = int16_t(reg - val); setNZ(s16); C = s16 >= 0;
-			#define AND(val) a &= val; setNZ(a);
-			#define ORA(val) a |= val; setNZ(a);
-			#define EOR(val) a ^= val; setNZ(a);
-			#define ADC(val) u8 = val; u16 = uint16_t(a) + uint16_t(u8) +  C; setNZVC(a, +int16_t(u8), u16, 0); a = uint8_t(u16);
-			#define SBC(val) u8 = val; s16 =  int16_t(a) -  int16_t(u8) - !C; setNZVC(a, -int16_t(u8), s16, 1); a = uint8_t(s16);
-			
-			#define ASL(val) p8 = &val; u8 = *p8; C = u8 & 0x80; *p8 = u8 <<= 1; setNZ(u8);
-			#define LSR(val) p8 = &val; u8 = *p8; C = u8 & 0x01; *p8 = u8 >>= 1; setNZ(u8);
-			
-			#define ROL(val) p8 = &val; u16 = uint16_t(*p8 << 1 | C); C = u16 & 0x100; *p8 = uint8_t(u16);       setNZ(u16);
-			#define ROR(val) p8 = &val; u16 = uint16_t(*p8 | C << 8); C = u16 & 0x001; *p8 = uint8_t(u16 >>= 1); setNZ(u16);
-			
-			#define INC(val) u8 = ++(val); setNZ(u8);
-			#define DEC(val) u8 = --(val); setNZ(u8);
-			
-			#define PUSH(val) (mem[STACK_POS + sp--] = uint8_t(val))
-			#define PULL() mem[STACK_POS + ++sp]
-			
-			#define PACK_FLAGS() uint8_t(N << 7 | V << 6 | 1 << 5 | B << 4 | D << 3 | I << 2 | Z << 1 | C)
-			#define FLAG_N(val) (((val) >> 7) & 0x1)
-			#define FLAG_V(val) (((val) >> 6) & 0x1)
-			#define FLAG_B(val) (((val) >> 4) & 0x1)
-			#define FLAG_D(val) (((val) >> 3) & 0x1)
-			#define FLAG_I(val) (((val) >> 2) & 0x1)
-			#define FLAG_Z(val) (((val) >> 1) & 0x1)
-			#define FLAG_C(val) (((val) >> 0) & 0x1)
-			
-			// Буферные переменные
-			uint8_t u8;
-			int16_t s16;
-			uint16_t u16;
-			uint8_t* p8;
-			
-			uint8_t insn = mem[pc];
+		
+		// Буферные переменные
+		uint8_t u8;
+		int16_t s16;
+		uint16_t u16;
+		uint16_t ea;
+		uint8_t ptr;
+		
+		DecodedInsn insn;
+		uint16_t op;
+		
+	#if THREADED_DISPATCH
+		void* handlers[FUSION_HANDLER + FUSION_COUNT];
+		std::fill(std::begin(handlers), std::end(handlers), &&L_UNKNOWN);
+		
+		#define SET_HANDLER(opcode, mnemonic, mode, cycles) handlers[opcode] = &&L_##opcode;
+		INT6502_OPCODES(SET_HANDLER)
+		#undef SET_HANDLER
+		
+		#define SET_FUSED_HANDLER(name, description, ...) handlers[FUSION_HANDLER + FUSION_##name] = &&L_FUSION_##name;
+		INT6502_FUSIONS(SET_FUSED_HANDLER)
+		#undef SET_FUSED_HANDLER
+		
+		if (B) goto stop;
+		DISPATCH();
+	#else
+		while (!B && remaining != 0) {
+			// Копия, так как запись в память может сбросить слот кэша
+			FETCH();
 			
-			switch (insn) {
-				case LDA_IMM:   LOAD(a, imm);  break;
-				case LDA_ZP:    LOAD(a, zp);   break;
-				case LDA_ZP_X:  LOAD(a, zpX);  break;
-				case LDA_ABS:   LOAD(a, abs);  break;
-				case LDA_ABS_X: LOAD(a, absX); break;
-				case LDA_ABS_Y: LOAD(a, absY); break;
-				case LDA_IND_X: LOAD(a, indX); break;
-				case LDA_IND_Y: LOAD(a, indY); break;
-				
-				case LDX_IMM:   LOAD(x, imm);  break;
-				case LDX_ZP:    LOAD(x, zp);   break;
-				case LDX_ZP_Y:  LOAD(x, zpY);  break;
-				case LDX_ABS:   LOAD(x, abs);  break;
-				case LDX_ABS_Y: LOAD(x, absY); break;
-				
-				case LDY_IMM:   LOAD(y, imm);  break;
-				case LDY_ZP:    LOAD(y, zp);   break;
-				case LDY_ZP_X:  LOAD(y, zpX);  break;
-				case LDY_ABS:   LOAD(y, abs);  break;
-				case LDY_ABS_X: LOAD(y, absX); break;
-				
-				
-				case STA_ZP:    zp = a;   break;
-				case STA_ZP_X:  zpX = a;  break;
-				case STA_ABS:   abs = a;  break;
-				case STA_ABS_X: absX = a; break;
-				case STA_ABS_Y: absY = a; break;
-				case STA_IND_X: indX = a; break;
-				case STA_IND_Y: indY = a; break;
-				
-				case STX_ZP:    zp = x;   break;
-				case STX_ZP_Y:  zpY = x;  break;
-				case STX_ABS:   abs = x;  break;
-				
-				case STY_ZP:    zp = y;   break;
-				case STY_ZP_X:  zpX = y;  break;
-				case STY_ABS:   abs = y;  break;
-				
-				
-				case CMP_IMM:   CMP(a, imm);  break;
-				case CMP_ZP:    CMP(a, zp);   break;
-				case CMP_ZP_X:  CMP(a, zpX);  break;
-				case CMP_ABS:   CMP(a, abs);  break;
-				case CMP_ABS_X: CMP(a, absX); break;
-				case CMP_ABS_Y: CMP(a, absY); break;
-				case CMP_IND_X: CMP(a, indX); break;
-				case CMP_IND_Y: CMP(a, indY); break;
-				
-				case CPX_IMM:   CMP(x, imm); break;
-				case CPX_ZP:    CMP(x, zp);  break;
-				case CPX_ABS:   CMP(x, abs); break;
-				
-				case CPY_IMM:   CMP(y, imm); break;
-				case CPY_ZP:    CMP(y, zp);  break;
-				case CPY_ABS:   CMP(y, abs); break;
-				
-				case BIT_ZP:    u8 = zp;  N = u8 & 0x80; V = u8 & 0x40; Z = !(u8 & a); break;
-				case BIT_ABS:   u8 = abs; N = u8 & 0x80; V = u8 & 0x40; Z = !(u8 & a); break;
-				
-				case AND_IMM:   AND(imm);  break;
-				case AND_ZP:    AND(zp);   break;
-				case AND_ZP_X:  AND(zpX);  break;
-				case AND_ABS:   AND(abs);  break;
-				case AND_ABS_X: AND(absX); break;
-				case AND_ABS_Y: AND(absY); break;
-				case AND_IND_X: AND(indX); break;
-				case AND_IND_Y: AND(indY); break;
-				
-				case ORA_IMM:   ORA(imm);  break;
-				case ORA_ZP:    ORA(zp);   break;
-				case ORA_ZP_X:  ORA(zpX);  break;
-				case ORA_ABS:   ORA(abs);  break;
-				case ORA_ABS_X: ORA(absX); break;
-				case ORA_ABS_Y: ORA(absY); break;
-				case ORA_IND_X: ORA(indX); break;
-				case ORA_IND_Y: ORA(indY); break;
-				
-				case EOR_IMM:   EOR(imm);  break;
-				case EOR_ZP:    EOR(zp);   break;
-				case EOR_ZP_X:  EOR(zpX);  break;
-				case EOR_ABS:   EOR(abs);  break;
-				case EOR_ABS_X: EOR(absX); break;
-				case EOR_ABS_Y: EOR(absY); break;
-				case EOR_IND_X: EOR(indX); break;
-				case EOR_IND_Y: EOR(indY); break;
-				
-				case ADC_IMM:   ADC(imm);  break;
-				case ADC_ZP:    ADC(zp);   break;
-				case ADC_ZP_X:  ADC(zpX);  break;
-				case ADC_ABS:   ADC(abs);  break;
-				case ADC_ABS_X: ADC(absX); break;
-				case ADC_ABS_Y: ADC(absY); break;
-				case ADC_IND_X: ADC(indX); break;
-				case ADC_IND_Y: ADC(indY); break;
-				
-				case SBC_IMM:   SBC(imm);  break;
-				case SBC_ZP:    SBC(zp);   break;
-				case SBC_ZP_X:  SBC(zpX);  break;
-				case SBC_ABS:   SBC(abs);  break;
-				case SBC_ABS_X: SBC(absX); break;
-				case SBC_ABS_Y: SBC(absY); break;
-				case SBC_IND_X: SBC(indX); break;
-				case SBC_IND_Y: SBC(indY); break;
-				
-				case ASL_A:     ASL(a);    break;
-				case ASL_ZP:    ASL(zp);   break;
-				case ASL_ZP_X:  ASL(zpX);  break;
-				case ASL_ABS:   ASL(abs);  break;
-				case ASL_ABS_X: ASL(absX); break;
-				
-				case LSR_A:     LSR(a);    break;
-				case LSR_ZP:    LSR(zp);   break;
-				case LSR_ZP_X:  LSR(zpX);  break;
-				case LSR_ABS:   LSR(abs);  break;
-				case LSR_ABS_X: LSR(absX); break;
-				
-				case ROL_A:     ROL(a);    break;
-				case ROL_ZP:    ROL(zp);   break;
-				case ROL_ZP_X:  ROL(zpX);  break;
-				case ROL_ABS:   ROL(abs);  break;
-				case ROL_ABS_X: ROL(absX); break;
-				
-				case ROR_A:     ROR(a);    break;
-				case ROR_ZP:    ROR(zp);   break;
-				case ROR_ZP_X:  ROR(zpX);  break;
-				case ROR_ABS:   ROR(abs);  break;
-				case ROR_ABS_X: ROR(absX); break;
-				
-				case INC_ZP:    INC(zp);   break;
-				case INC_ZP_X:  INC(zpX);  break;
-				case INC_ABS:   INC(abs);  break;
-				case INC_ABS_X: INC(absX); break;
-				
-				case DEC_ZP:    DEC(zp);   break;
-				case DEC_ZP_X:  DEC(zpX);  break;
-				case DEC_ABS:   DEC(abs);  break;
-				case DEC_ABS_X: DEC(absX); break;
-				
-				case INX: x++; setNZ(x); break;
-				case INY: y++; setNZ(y); break;
-				case DEX: x--; setNZ(x); break;
-				case DEY: y--; setNZ(y); break;
-				
-				case CLC: C = 0; break;
-				case CLI: I = 0; break;
-				case CLD: D = 0; break;
-				case CLV: V = 0; break;
-				case SEC: C = 1; break;
-				case SEI: I = 1; break;
-				case SED: D = 1; break;
-				
-				case TAX: LOAD(x, a);  break;
-				case TXA: LOAD(a, x);  break;
-				case TAY: LOAD(y, a);  break;
-				case TYA: LOAD(a, y);  break;
-				case TSX: LOAD(x, sp); break;
-				case TXS: sp = x;      break; // Не влияет на флаги
-				
-				case PHA: PUSH(a); break;
-				case PHP: PUSH(PACK_FLAGS()); break;
-				
-				case PLA: a = PULL(); setNZ(a); break;
-				case PLP:
+			switch (insn.handler) {
+	#endif
+				HANDLER(LDA_IMM)   LOAD(a, imm);  NEXT();
+				HANDLER(LDA_ZP)    LOAD(a, zp);   NEXT();
+				HANDLER(LDA_ZP_X)  LOAD(a, zpX);  NEXT();
+				HANDLER(LDA_ABS)   LOAD(a, abs);  NEXT();
+				HANDLER(LDA_ABS_X) LOAD(a, absX); NEXT();
+				HANDLER(LDA_ABS_Y) LOAD(a, absY); NEXT();
+				HANDLER(LDA_IND_X) LOAD(a, indX); NEXT();
+				HANDLER(LDA_IND_Y) LOAD(a, indY); NEXT();
+				
+				HANDLER(LDX_IMM)   LOAD(x, imm);  NEXT();
+				HANDLER(LDX_ZP)    LOAD(x, zp);   NEXT();
+				HANDLER(LDX_ZP_Y)  LOAD(x, zpY);  NEXT();
+				HANDLER(LDX_ABS)   LOAD(x, abs);  NEXT();
+				HANDLER(LDX_ABS_Y) LOAD(x, absY); NEXT();
+				
+				HANDLER(LDY_IMM)   LOAD(y, imm);  NEXT();
+				HANDLER(LDY_ZP)    LOAD(y, zp);   NEXT();
+				HANDLER(LDY_ZP_X)  LOAD(y, zpX);  NEXT();
+				HANDLER(LDY_ABS)   LOAD(y, abs);  NEXT();
+				HANDLER(LDY_ABS_X) LOAD(y, absX); NEXT();
+				
+				
+				HANDLER(STA_ZP)    STORE(aZP,   a); NEXT();
+				HANDLER(STA_ZP_X)  STORE(aZPX,  a); NEXT();
+				HANDLER(STA_ABS)   STORE(aABS,  a); NEXT();
+				HANDLER(STA_ABS_X) STORE(aABSX, a); NEXT();
+				HANDLER(STA_ABS_Y) STORE(aABSY, a); NEXT();
+				HANDLER(STA_IND_X) STORE(aINDX, a); NEXT();
+				HANDLER(STA_IND_Y) STORE(aINDY, a); NEXT();
+				
+				HANDLER(STX_ZP)    STORE(aZP,   x); NEXT();
+				HANDLER(STX_ZP_Y)  STORE(aZPY,  x); NEXT();
+				HANDLER(STX_ABS)   STORE(aABS,  x); NEXT();
+				
+				HANDLER(STY_ZP)    STORE(aZP,   y); NEXT();
+				HANDLER(STY_ZP_X)  STORE(aZPX,  y); NEXT();
+				HANDLER(STY_ABS)   STORE(aABS,  y); NEXT();
+				
+				
+				HANDLER(CMP_IMM)   CMP(a, imm);  NEXT();
+				HANDLER(CMP_ZP)    CMP(a, zp);   NEXT();
+				HANDLER(CMP_ZP_X)  CMP(a, zpX);  NEXT();
+				HANDLER(CMP_ABS)   CMP(a, abs);  NEXT();
+				HANDLER(CMP_ABS_X) CMP(a, absX); NEXT();
+				HANDLER(CMP_ABS_Y) CMP(a, absY); NEXT();
+				HANDLER(CMP_IND_X) CMP(a, indX); NEXT();
+				HANDLER(CMP_IND_Y) CMP(a, indY); NEXT();
+				
+				HANDLER(CPX_IMM)   CMP(x, imm); NEXT();
+				HANDLER(CPX_ZP)    CMP(x, zp);  NEXT();
+				HANDLER(CPX_ABS)   CMP(x, abs); NEXT();
+				
+				HANDLER(CPY_IMM)   CMP(y, imm); NEXT();
+				HANDLER(CPY_ZP)    CMP(y, zp);  NEXT();
+				HANDLER(CPY_ABS)   CMP(y, abs); NEXT();
+				
+				HANDLER(BIT_ZP)    u8 = zp;  nz = uint16_t((u8 & 0x80) << 8 | bool(u8 & a)); V = u8 & 0x40; NEXT();
+				HANDLER(BIT_ABS)   u8 = abs; nz = uint16_t((u8 & 0x80) << 8 | bool(u8 & a)); V = u8 & 0x40; NEXT();
+				
+				HANDLER(AND_IMM)   AND(imm);  NEXT();
+				HANDLER(AND_ZP)    AND(zp);   NEXT();
+				HANDLER(AND_ZP_X)  AND(zpX);  NEXT();
+				HANDLER(AND_ABS)   AND(abs);  NEXT();
+				HANDLER(AND_ABS_X) AND(absX); NEXT();
+				HANDLER(AND_ABS_Y) AND(absY); NEXT();
+				HANDLER(AND_IND_X) AND(indX); NEXT();
+				HANDLER(AND_IND_Y) AND(indY); NEXT();
+				
+				HANDLER(ORA_IMM)   ORA(imm);  NEXT();
+				HANDLER(ORA_ZP)    ORA(zp);   NEXT();
+				HANDLER(ORA_ZP_X)  ORA(zpX);  NEXT();
+				HANDLER(ORA_ABS)   ORA(abs);  NEXT();
+				HANDLER(ORA_ABS_X) ORA(absX); NEXT();
+				HANDLER(ORA_ABS_Y) ORA(absY); NEXT();
+				HANDLER(ORA_IND_X) ORA(indX); NEXT();
+				HANDLER(ORA_IND_Y) ORA(indY); NEXT();
+				
+				HANDLER(EOR_IMM)   EOR(imm);  NEXT();
+				HANDLER(EOR_ZP)    EOR(zp);   NEXT();
+				HANDLER(EOR_ZP_X)  EOR(zpX);  NEXT();
+				HANDLER(EOR_ABS)   EOR(abs);  NEXT();
+				HANDLER(EOR_ABS_X) EOR(absX); NEXT();
+				HANDLER(EOR_ABS_Y) EOR(absY); NEXT();
+				HANDLER(EOR_IND_X) EOR(indX); NEXT();
+				HANDLER(EOR_IND_Y) EOR(indY); NEXT();
+				
+				HANDLER(ADC_IMM)   ADC(imm);  NEXT();
+				HANDLER(ADC_ZP)    ADC(zp);   NEXT();
+				HANDLER(ADC_ZP_X)  ADC(zpX);  NEXT();
+				HANDLER(ADC_ABS)   ADC(abs);  NEXT();
+				HANDLER(ADC_ABS_X) ADC(absX); NEXT();
+				HANDLER(ADC_ABS_Y) ADC(absY); NEXT();
+				HANDLER(ADC_IND_X) ADC(indX); NEXT();
+				HANDLER(ADC_IND_Y) ADC(indY); NEXT();
+				
+				HANDLER(SBC_IMM)   SBC(imm);  NEXT();
+				HANDLER(SBC_ZP)    SBC(zp);   NEXT();
+				HANDLER(SBC_ZP_X)  SBC(zpX);  NEXT();
+				HANDLER(SBC_ABS)   SBC(abs);  NEXT();
+				HANDLER(SBC_ABS_X) SBC(absX); NEXT();
+				HANDLER(SBC_ABS_Y) SBC(absY); NEXT();
+				HANDLER(SBC_IND_X) SBC(indX); NEXT();
+				HANDLER(SBC_IND_Y) SBC(indY); NEXT();
+				
+				HANDLER(ASL_A)     ASL(a);            NEXT();
+				HANDLER(ASL_ZP)    RMW(aZP,   ASL);   NEXT();
+				HANDLER(ASL_ZP_X)  RMW(aZPX,  ASL);   NEXT();
+				HANDLER(ASL_ABS)   RMW(aABS,  ASL);   NEXT();
+				HANDLER(ASL_ABS_X) RMW(aABSX, ASL);   NEXT();
+				
+				HANDLER(LSR_A)     LSR(a);            NEXT();
+				HANDLER(LSR_ZP)    RMW(aZP,   LSR);   NEXT();
+				HANDLER(LSR_ZP_X)  RMW(aZPX,  LSR);   NEXT();
+				HANDLER(LSR_ABS)   RMW(aABS,  LSR);   NEXT();
+				HANDLER(LSR_ABS_X) RMW(aABSX, LSR);   NEXT();
+				
+				HANDLER(ROL_A)     ROL(a);            NEXT();
+				HANDLER(ROL_ZP)    RMW(aZP,   ROL);   NEXT();
+				HANDLER(ROL_ZP_X)  RMW(aZPX,  ROL);   NEXT();
+				HANDLER(ROL_ABS)   RMW(aABS,  ROL);   NEXT();
+				HANDLER(ROL_ABS_X) RMW(aABSX, ROL);   NEXT();
+				
+				HANDLER(ROR_A)     ROR(a);            NEXT();
+				HANDLER(ROR_ZP)    RMW(aZP,   ROR);   NEXT();
+				HANDLER(ROR_ZP_X)  RMW(aZPX,  ROR);   NEXT();
+				HANDLER(ROR_ABS)   RMW(aABS,  ROR);   NEXT();
+				HANDLER(ROR_ABS_X) RMW(aABSX, ROR);   NEXT();
+				
+				HANDLER(INC_ZP)    RMW(aZP,   INC);   NEXT();
+				HANDLER(INC_ZP_X)  RMW(aZPX,  INC);   NEXT();
+				HANDLER(INC_ABS)   RMW(aABS,  INC);   NEXT();
+				HANDLER(INC_ABS_X) RMW(aABSX, INC);   NEXT();
+				
+				HANDLER(DEC_ZP)    RMW(aZP,   DEC);   NEXT();
+				HANDLER(DEC_ZP_X)  RMW(aZPX,  DEC);   NEXT();
+				HANDLER(DEC_ABS)   RMW(aABS,  DEC);   NEXT();
+				HANDLER(DEC_ABS_X) RMW(aABSX, DEC);   NEXT();
+				
+				HANDLER(INX) INC(x); NEXT();
+				HANDLER(INY) INC(y); NEXT();
+				HANDLER(DEX) DEC(x); NEXT();
+				HANDLER(DEY) DEC(y); NEXT();
+				
+				HANDLER(CLC) cw = 0;     NEXT();
+				HANDLER(CLI) I = 0;      NEXT();
+				HANDLER(CLD) D = 0;      NEXT();
+				HANDLER(CLV) V = 0;      NEXT();
+				HANDLER(SEC) cw = 0x100; NEXT();
+				HANDLER(SEI) I = 1;      NEXT();
+				HANDLER(SED) D = 1;      NEXT();
+				
+				HANDLER(TAX) LOAD(x, a);  NEXT();
+				HANDLER(TXA) LOAD(a, x);  NEXT();
+				HANDLER(TAY) LOAD(y, a);  NEXT();
+				HANDLER(TYA) LOAD(a, y);  NEXT();
+				HANDLER(TSX) LOAD(x, sp); NEXT();
+				HANDLER(TXS) sp = x;      NEXT(); // Не влияет на флаги
+				
+				HANDLER(PHA) PUSH(a); NEXT();
+				HANDLER(PHP) PUSH(PACK_FLAGS()); NEXT();
+				
+				HANDLER(PLA) a = PULL(); setNZ(a); NEXT();
+				HANDLER(PLP)
 					u8 = PULL();
-					N = FLAG_N(u8);
+					UNPACK_NZC(u8);
 					V = FLAG_V(u8);
 					B = FLAG_B(u8);
 					D = FLAG_D(u8);
 					I = FLAG_I(u8);
-					Z = FLAG_Z(u8);
-					C = FLAG_C(u8);
-					break;
-				
-				case BEQ: if (Z == 1) pc += int8_t(imm); break;
-				case BNE: if (Z == 0) pc += int8_t(imm); break;
-				case BMI: if (N == 1) pc += int8_t(imm); break;
-				case BPL: if (N == 0) pc += int8_t(imm); break;
-				case BCS: if (C == 1) pc += int8_t(imm); break;
-				case BCC: if (C == 0) pc += int8_t(imm); break;
-				case BVS: if (V == 1) pc += int8_t(imm); break;
-				case BVC: if (V == 0) pc += int8_t(imm); break;
-				
-				case JMP_ABS:
-					pc = get16(pc+1, 0);
-					continue;
-				
-				case JMP_IND:
-					u16 = get16(pc+1, 0);
-					pc = get16(u16, 0);
-					continue;
-				
-				case JSR:
-					u16 = uint16_t(pc + SIZES[JSR] - 1);
+					NEXT_OR_STOP();
+				
+				// Адрес перехода уже вычислен декодером
+				HANDLER(BEQ) if (Z_FLAG == 1) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BNE) if (Z_FLAG == 0) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BMI) if (N_FLAG == 1) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BPL) if (N_FLAG == 0) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BCS) if (C_FLAG == 1) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BCC) if (C_FLAG == 0) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BVS) if (V      == 1) { BRANCH(op, pc + insn.size); } NEXT();
+				HANDLER(BVC) if (V      == 0) { BRANCH(op, pc + insn.size); } NEXT();
+				
+				HANDLER(JMP_ABS)
+					JUMP(op);
+				
+				HANDLER(JMP_IND)
+					JUMP(get16(op, 0));
+				
+				HANDLER(JSR)
+					u16 = uint16_t(pc + insn.size - 1);
 					PUSH(u16 >> 8);
 					PUSH(u16);
 					
-					pc = get16(pc+1, 0);
-					continue;
+					JUMP(op);
 				
-				case RTS:
-					pc = PULL();
-					pc |= (PULL() << 8);
-					pc += 1;
-					continue;
+				HANDLER(RTS)
+					u16 = PULL();
+					u16 |= (PULL() << 8);
+					JUMP(uint16_t(u16 + 1));
 				
 				
-				case BRK: B = 1; break;
-				case RTI: B = 0; break;
+				HANDLER(BRK) B = 1; NEXT_OR_STOP();
+				HANDLER(RTI) B = 0; NEXT();
 				
-				case NOP: break;
+				HANDLER(NOP) NEXT();
 				
-				default:
-					addLine(30, "Error: unknown instruction $%02x", insn);
-					return UNKNOWN_INSTRUCTION_ERROR;
+				
+				// Суперинструкции (см. fusion.h)
+				FUSED_HANDLER(INX_CPX_BNE)
+					INC(x);
+					CMP(x, imm);
+					if (Z_FLAG == 0) { BRANCH(insn.operand2, pc + insn.fusedSize); }
+					FUSED_NEXT();
+				
+				FUSED_HANDLER(INY_CPY_BNE)
+					INC(y);
+					CMP(y, imm);
+					if (Z_FLAG == 0) { BRANCH(insn.operand2, pc + insn.fusedSize); }
+					FUSED_NEXT();
+				
+				FUSED_HANDLER(DEX_BNE) DEC(x); if (Z_FLAG == 0) { BRANCH(op, pc + insn.fusedSize); } FUSED_NEXT();
+				FUSED_HANDLER(DEY_BNE) DEC(y); if (Z_FLAG == 0) { BRANCH(op, pc + insn.fusedSize); } FUSED_NEXT();
+				
+				FUSED_HANDLER(CMP_IMM_BEQ) CMP(a, imm); if (Z_FLAG == 1) { BRANCH(insn.operand2, pc + insn.fusedSize); } FUSED_NEXT();
+				FUSED_HANDLER(CMP_IMM_BNE) CMP(a, imm); if (Z_FLAG == 0) { BRANCH(insn.operand2, pc + insn.fusedSize); } FUSED_NEXT();
+				
+				FUSED_HANDLER(LDA_ABS_X_STA_ABS_X) LOAD(a, absX); op = insn.operand2; STORE(aABSX, a); FUSED_NEXT();
+				FUSED_HANDLER(LDA_IMM_STA_ZP)      LOAD(a, imm);  op = insn.operand2; STORE(aZP,   a); FUSED_NEXT();
+				FUSED_HANDLER(LDA_IMM_STA_ABS)     LOAD(a, imm);  op = insn.operand2; STORE(aABS,  a); FUSED_NEXT();
+				FUSED_HANDLER(LDA_ZP_STA_ZP)       LOAD(a, zp);   op = insn.operand2; STORE(aZP,   a); FUSED_NEXT();
+				
+				UNKNOWN_HANDLER
+					// Инструкция не выполнена: pc остаётся на ней
+					remaining += insn.count;
+					cycles -= insn.fusedCycles;
+					res = UNKNOWN_INSTRUCTION_ERROR;
+					goto save;
+				
+	#if THREADED_DISPATCH
+		stop:
+	#else
 			}
 			
-			pc += SIZES[insn];
+			pc += insn.size;
 		}
+	#endif
 		
+	save:
+		PROFILE_FLUSH();
 		
 		state->a = a;
 		state->x = x;
@@ -524,42 +485,212 @@ namespace int6502 {
 		state->sp = sp;
 		state->pc = pc;
 		state->flags = PACK_FLAGS();
-		return EXIT_SUCCESS;
+		state->insns += limit - remaining;
+		state->cycles = cycles;
+		return res;
 	}
 	
+	#if THREADED_DISPATCH
+		#pragma GCC diagnostic pop
+	#endif
 	
+	const char* getDispatchName() {
+		return THREADED_DISPATCH ? "threaded" : "switch";
+	}
 	
 	
+	processor_state initialState() {
+		processor_state state;
+		state.a = state.x = state.y = 0;
+		state.sp = 0xFF;
+		state.pc = CODE_POS;
+		state.flags = 0x20;
+		state.insns = 0;
+		state.cycles = 0;
+		state.random.seed(1);
+		return state;
+	}
+	
+	
+	static const uint64_t
+			THROTTLE_SLICE_MS = 10,
+			FRAME_CYCLES = 20000, // Кадр публикуется не реже, чем раз в FRAME_CYCLES тактов
+			AVERAGE_CYCLES = 4;   // Среднее количество тактов на инструкцию для оценки размера порции
+	
+	
+	// Связь потока выполнения с потоком отрисовки
+	struct Display {
+		FrameBuffer frames;
+		InputMailbox input;
+	};
+	
+	static_assert(WIDTH * HEIGHT == GPU_SIZE, "Frame size must match GPU memory size");
+	
+	
+	static MachineOptions getMachineOptions(const ExecuteOptions& options) {
+		MachineOptions machineOptions;
+		machineOptions.jit = options.jit;
+		machineOptions.fusion = options.fusion;
+		machineOptions.seed = options.seeded ? options.seed : uint64_t(time(NULL));
+		machineOptions.random = options.random;
+		machineOptions.profiler = options.profiler;
+		machineOptions.tracer = options.tracer;
+		return machineOptions;
+	}
 	
-	int executeCode(const vector<uint8_t>& code) {
-		uint8_t* mem = (uint8_t*)malloc(MEM_SIZE);
+	
+	// Загружает код или восстанавливает снимок из options.
+	// Если генератор инициализирует сам запуск, его начальное значение попадает в запись ввода
+	static int prepare(Machine& machine, const MachineOptions& machineOptions, const vector<uint8_t>& code, const ExecuteOptions& options) {
+		int res = machine.load(code, options.loadAddress, options.entry);
 		
-		if (mem == NULL) {
-			return INTERNAL_ERROR;
+		if (res == EXIT_SUCCESS && options.restoreState != NULL) {
+			res = machine.restore(*options.restoreState);
+			
+			if (res == EXIT_SUCCESS && options.seeded) {
+				machine.reseed(options.seed);
+			}
 		}
 		
-		memset(mem, 0, MEM_SIZE);
-		memcpy(mem + CODE_POS, code.data(), code.size());
+		if (res == EXIT_SUCCESS && options.recorder != NULL && (options.restoreState == NULL || options.seeded)) {
+			options.recorder->recordSeed(machineOptions.seed, machineOptions.random);
+		}
 		
+		return res;
+	}
+	
+	
+	// Выполняет программу до инструкции BRK.
+	// Если display не NULL, код выполняется порциями, между которыми публикуется кадр
+	// (если видеопамять изменилась) и записывается в память нажатая клавиша.
+	// Если включена перемотка, между порциями делаются снимки, а по команде из display
+	// выполнение возвращается к предыдущему снимку и приостанавливается до команды продолжения.
+	// При воспроизведении записи ввода порции заканчиваются ровно на инструкциях, перед которыми нажимались клавиши
+	static int execute(Machine& machine, const ExecuteOptions& options, Display* display) {
+		std::unique_ptr<RewindBuffer> rewind;
+		bool paused = false;
+		bool stopped = false; // Остановлено пользователем или концом записи ввода
+		
+		const InputLog* const replay = options.replay;
+		size_t nextEvent = 0;
+		
+		if (display != NULL) {
+			machine.setFrameHandler([display] (const uint8_t* gpuMem) { display->frames.publish(gpuMem); });
+			
+			if (options.rewindInterval != 0 && replay == NULL) {
+				rewind.reset(new RewindBuffer(options.rewindInterval, options.rewindDepth));
+				rewind->record(machine);
+			}
+		}
 		
-		std::thread drawThread(draw, mem + INPUT_POS, mem + GPU_POS);
+		auto sync = [&]() {
+			if (display != NULL) {
+				const uint8_t key = display->input.take();
+				
+				// При воспроизведении клавиатура игнорируется
+				if (key != 0 && replay == NULL) {
+					machine.setInput(key);
+					
+					if (options.recorder != NULL) {
+						options.recorder->recordKey(machine.getState(), key);
+					}
+				}
+				
+				if (display->input.takeStop()) {
+					stopped = true;
+				}
+				
+				if (rewind != nullptr) {
+					for (unsigned count = display->input.takeRewinds(); count != 0; count--) {
+						rewind->stepBack(machine);
+						paused = true;
+						
+						if (options.recorder != NULL) {
+							options.recorder->recordRewind(machine.getState());
+						}
+					}
+					
+					if (display->input.takeResume()) {
+						paused = false;
+					}
+				}
+			}
+			
+			if (replay != NULL) {
+				const uint64_t insns = machine.getState().insns;
+				
+				for (; nextEvent < replay->events.size() && replay->events[nextEvent].insns <= insns; nextEvent++) {
+					machine.setInput(replay->events[nextEvent].key);
+				}
+				
+				if (nextEvent == replay->events.size() && (!replay->stopped || insns >= replay->stopInsns)) {
+					stopped = true;
+				}
+			}
+		};
 		
-		processor_state state;
-		int res = run(mem, &state);
+		// Ограничивает порцию так, чтобы она закончилась на следующем событии записи
+		auto untilEvent = [&](uint64_t count) {
+			if (replay == NULL) return count;
+			
+			const uint64_t next = nextEvent < replay->events.size() ? replay->events[nextEvent].insns : replay->stopInsns;
+			return std::min(count, next - machine.getState().insns);
+		};
 		
-		stopped = true;
-		drawThread.join();
+		uint64_t batch = display != NULL ? FRAME_CYCLES / AVERAGE_CYCLES : UINT64_MAX;
 		
-		if (res != EXIT_SUCCESS) {
-			free(mem);
-			return res;
+		if (options.clock != 0) {
+			batch = std::min(batch, std::max<uint64_t>(1, options.clock * THROTTLE_SLICE_MS / 1000 / AVERAGE_CYCLES));
 		}
 		
+		// Код выполняется порциями примерно по THROTTLE_SLICE_MS миллисекунд эмулируемого времени,
+		// после каждой порции поток спит, пока реальное время не догонит эмулируемое
+		using namespace std::chrono;
 		
-		addLine(46, "a = $%02x, x = $%02x, y = $%02x, sp = $%02x, pc = $%03x", state.a, state.x, state.y, state.sp, state.pc);
+		auto start = steady_clock::now();
+		uint64_t startCycles = machine.getState().cycles;
+		int res = EXIT_SUCCESS;
 		
-		addLine("N V - B D I Z C");
-		addLine(15, "%d %d 1 %d %d %d %d %d",
+		do {
+			sync();
+			
+			if (stopped) break;
+			
+			// На паузе ждём команд, а отсчёт эмулируемого времени начинается заново
+			if (paused) {
+				std::this_thread::sleep_for(milliseconds(THROTTLE_SLICE_MS));
+				start = steady_clock::now();
+				startCycles = machine.getState().cycles;
+				continue;
+			}
+			
+			res = machine.step(untilEvent(batch));
+			
+			if (rewind != nullptr) {
+				rewind->record(machine);
+			}
+			
+			if (options.clock != 0) {
+				duration<double> emulated(double(machine.getState().cycles - startCycles) / options.clock);
+				std::this_thread::sleep_until(start + duration_cast<steady_clock::duration>(emulated));
+			}
+			
+		} while (res == EXIT_SUCCESS && !machine.isStopped());
+		
+		if (options.recorder != NULL) {
+			options.recorder->recordStop(machine.getState());
+		}
+		
+		return res;
+	}
+	
+	
+	// Добавляет состояние процессора и дамп памяти в конец страницы
+	static void addReport(Page& page, const processor_state& state, const uint8_t* mem) {
+		page.addLine(47, "a = $%02x, x = $%02x, y = $%02x, sp = $%02x, pc = $%03x", state.a, state.x, state.y, state.sp, state.pc);
+		
+		page.addLine("N V - B D I Z C");
+		page.addLine(15, "%d %d 1 %d %d %d %d %d",
 			FLAG_N(state.flags),
 			FLAG_V(state.flags),
 			FLAG_B(state.flags),
@@ -569,24 +700,125 @@ namespace int6502 {
 			FLAG_C(state.flags)
 		);
 		
-		dump("Zero page dump:", mem, 0,         16, 16);
-		dump("Stack dump:",     mem, STACK_POS, 16, 16);
-		dump("GPU dump:",       mem, GPU_POS,   16, 64);
-		dump("Code dump:",      mem, CODE_POS,  16, 16);
+		page.dump("Zero page dump:", mem, 0,         16, 16);
+		page.dump("Stack dump:",     mem, STACK_POS, 16, 16);
+		page.dump("GPU dump:",       mem, GPU_POS,   16, 64);
+		page.dump("Code dump:",      mem, CODE_POS,  16, 16);
+	}
+	
+	
+	static void writeJitStats(FILE* file, const JitStats& stats) {
+		fprintf(file, "JIT: %llu blocks compiled in %.3f ms, %llu native / %llu interpreted instructions, %llu blocks invalidated\n",
+				(unsigned long long)stats.blocks, stats.compileSeconds * 1e3,
+				(unsigned long long)stats.nativeInsns, (unsigned long long)stats.fallbackInsns,
+				(unsigned long long)stats.invalidations);
+	}
+	
+	
+	// Выводит, сколько раз выполнялась каждая суперинструкция
+	static void writeFusionStats(FILE* file, const uint64_t* fusionHits) {
+		for (int i = 0; i < FUSION_COUNT; i++) {
+			if (fusionHits[i] != 0) {
+				fprintf(file, "Fusion %-22s %llu\n", getFusionDescription(Fusion(i)), (unsigned long long)fusionHits[i]);
+			}
+		}
+	}
+	
+	
+	int executeCode(const vector<uint8_t>& code, const ExecuteOptions& options) {
+		const MachineOptions machineOptions = getMachineOptions(options);
+		Machine machine(machineOptions);
+		
+		int res = prepare(machine, machineOptions, code, options);
+		if (res != EXIT_SUCCESS) return res;
+		
 		
-		free(mem);
-		mem = NULL;
+		std::unique_ptr<Display> display(new Display);
 		
-		printLines();
+		if (!display->frames.isOpen()) {
+			return INTERNAL_ERROR;
+		}
+		
+		std::thread drawThread(draw, &display->frames, &display->input, options.maxFps, options.rewindInterval != 0);
+		
+		res = execute(machine, options, display.get());
+		
+		display->frames.close();
+		drawThread.join();
+		
+		if (options.saveState != NULL) {
+			*options.saveState = machine.snapshot();
+		}
+		
+		if (res != EXIT_SUCCESS) {
+			return res;
+		}
+		
+		
+		Page page;
+		addReport(page, machine.getState(), machine.getMemory());
+		
+		const JitStats* jitStats = machine.getJitStats();
+		
+		if (jitStats != NULL) {
+			page.addLine(64, "JIT: %llu blocks, %.3f ms", (unsigned long long)jitStats->blocks, jitStats->compileSeconds * 1e3);
+		}
+		
+		page.printLines();
 		refresh();
 		
 		
 		for (;;) {
 			switch (getch()) {
-				case KEY_UP:   scrollUp();   break;
-				case KEY_DOWN: scrollDown(); break;
+				case KEY_UP:   page.scrollUp();   break;
+				case KEY_DOWN: page.scrollDown(); break;
 				case 'q': return EXIT_SUCCESS;
 			}
 		}
 	}
+	
+	
+	int executeCodeHeadless(const vector<uint8_t>& code, FILE* out, const ExecuteOptions& options) {
+		const MachineOptions machineOptions = getMachineOptions(options);
+		Machine machine(machineOptions);
+		
+		int res = prepare(machine, machineOptions, code, options);
+		if (res != EXIT_SUCCESS) return res;
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		res = execute(machine, options, NULL);
+		
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		
+		if (options.saveState != NULL) {
+			*options.saveState = machine.snapshot();
+		}
+		
+		const processor_state& state = machine.getState();
+		const JitStats* jitStats = machine.getJitStats();
+		
+		if (res == EXIT_SUCCESS && options.stats != NULL) {
+			fprintf(options.stats, "Executed %llu instructions (%llu cycles) in %.3f s (%.2f MIPS)\n",
+					(unsigned long long)state.insns, (unsigned long long)state.cycles, elapsed.count(), state.insns / elapsed.count() / 1e6);
+			
+			if (jitStats != NULL) {
+				writeJitStats(options.stats, *jitStats);
+			}
+			
+			writeFusionStats(options.stats, machine.getFusionHits());
+		}
+		
+		Page page;
+		
+		if (res == EXIT_SUCCESS) {
+			addReport(page, state, machine.getMemory());
+			
+		} else if (res == UNKNOWN_INSTRUCTION_ERROR) {
+			page.addLine(30, "Error: unknown instruction $%02x", machine.getMemory()[state.pc]);
+		}
+		
+		page.writeLines(out);
+		return res;
+	}
 }
@@ -0,0 +1,74 @@
+#include "fusion.h"
+#include "decoder.h"
+
+namespace int6502 {
+	
+	struct FusionInfo {
+		const char* description;
+		uint8_t opcodes[3];
+		uint8_t count;
+	};
+	
+	template<typename... Opcodes>
+	static constexpr uint8_t countOpcodes(Opcodes...) {
+		return sizeof...(Opcodes);
+	}
+	
+	#define INIT_FUSION(name, description, ...) \
+		{ description, { __VA_ARGS__ }, countOpcodes(__VA_ARGS__) },
+	
+	static const FusionInfo FUSION_INFO[FUSION_COUNT] = {
+		INT6502_FUSIONS(INIT_FUSION)
+	};
+	
+	#undef INIT_FUSION
+	
+	
+	const char* getFusionDescription(Fusion fusion) {
+		return FUSION_INFO[fusion].description;
+	}
+	
+	
+	bool fuse(const uint8_t* mem, uint16_t pc, DecodedInsn& insn) {
+		if (uint32_t(pc) + MAX_FUSED_SIZE > MEM_SIZE) {
+			return false;
+		}
+		
+		for (int fusion = 0; fusion < FUSION_COUNT; fusion++) {
+			const FusionInfo& info = FUSION_INFO[fusion];
+			
+			if (insn.opcode != info.opcodes[0]) {
+				continue;
+			}
+			
+			uint16_t operands[2] = {};
+			uint8_t operandCount = 0;
+			uint8_t cycles = 0;
+			uint16_t addr = pc;
+			uint8_t i = 0;
+			
+			for (; i < info.count && mem[addr] == info.opcodes[i]; i++) {
+				DecodedInsn part = decode(mem, addr);
+				
+				if (part.size > 1) {
+					operands[operandCount++] = part.operand;
+				}
+				
+				cycles += part.cycles;
+				addr += part.size;
+			}
+			
+			if (i == info.count) {
+				insn.handler = uint16_t(FUSION_HANDLER + fusion);
+				insn.operand = operands[0];
+				insn.operand2 = operands[1];
+				insn.count = info.count;
+				insn.fusedSize = uint8_t(addr - pc);
+				insn.fusedCycles = cycles;
+				return true;
+			}
+		}
+		
+		return false;
+	}
+}
@@ -0,0 +1,133 @@
+#include "input_log.h"
+#include "error_codes.h"
+#include "util.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace int6502 {
+	
+	static const char* const INPUT_LOG_HEADER = "int6502-input";
+	static const unsigned INPUT_LOG_VERSION = 1;
+	
+	
+	// Возвращает название генератора для параметра --rng
+	static const char* getRandomKindName(RandomKind kind) {
+		switch (kind) {
+			#define RANDOM_KIND_NAME(kindName, option) case RandomKind::kindName: return option;
+			INT6502_RANDOM_KINDS(RANDOM_KIND_NAME)
+			#undef RANDOM_KIND_NAME
+		}
+		
+		return "";
+	}
+	
+	
+	int InputLog::load(const char* filename) {
+		FILE* file = fopen(filename, "r");
+		if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		char line[128];
+		int lineNumber = 0;
+		int res = EXIT_SUCCESS;
+		
+		while (res == EXIT_SUCCESS && fgets(line, sizeof(line), file) != nullptr) {
+			lineNumber++;
+			
+			char type[16], name[16];
+			unsigned version, key;
+			uint64_t insns, cycles;
+			
+			if (lineNumber == 1) {
+				if (sscanf(line, "%15s %u", type, &version) != 2 || strcmp(type, INPUT_LOG_HEADER) != 0) {
+					res = error(INVALID_SYNTAX_ERROR, "\"%s\" is not an input recording", filename);
+					
+				} else if (version != INPUT_LOG_VERSION) {
+					res = error(INVALID_SYNTAX_ERROR, "Unsupported input recording version %u", version);
+				}
+				
+				continue;
+			}
+			
+			if (sscanf(line, "%15s", type) != 1) {
+				continue;
+			}
+			
+			if (strcmp(type, "seed") == 0 && sscanf(line, "%*s %" SCNu64 " %15s", &seed, name) == 2 && parseRandomKind(name, random)) {
+				seeded = true;
+				
+			} else if (strcmp(type, "key") == 0 && sscanf(line, "%*s %" SCNu64 " %" SCNu64 " %x", &insns, &cycles, &key) == 3 && key <= 0xFF) {
+				if (!events.empty() && insns < events.back().insns) {
+					res = error(INVALID_SYNTAX_ERROR, "Input recording \"%s\", line %d: events are out of order", filename, lineNumber);
+				}
+				
+				events.push_back(InputEvent { insns, cycles, uint8_t(key) });
+				
+			} else if (strcmp(type, "rewind") == 0 && sscanf(line, "%*s %" SCNu64 " %" SCNu64, &insns, &cycles) == 2) {
+				// Снимок делается до записи клавиш в той же точке, поэтому они тоже отменяются
+				while (!events.empty() && events.back().insns >= insns) {
+					events.pop_back();
+				}
+				
+			} else if (strcmp(type, "stop") == 0 && sscanf(line, "%*s %" SCNu64 " %" SCNu64, &insns, &cycles) == 2) {
+				stopped = true;
+				stopInsns = insns;
+				
+			} else {
+				res = error(INVALID_SYNTAX_ERROR, "Input recording \"%s\", line %d: invalid record", filename, lineNumber);
+			}
+		}
+		
+		fclose(file);
+		
+		if (res == EXIT_SUCCESS && lineNumber == 0) {
+			res = error(INVALID_SYNTAX_ERROR, "\"%s\" is not an input recording", filename);
+		}
+		
+		return res;
+	}
+	
+	
+	InputRecorder::~InputRecorder() {
+		if (file != nullptr) {
+			fclose(file);
+		}
+	}
+	
+	int InputRecorder::open(const char* filename) {
+		file = fopen(filename, "w");
+		if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		fprintf(file, "%s %u\n", INPUT_LOG_HEADER, INPUT_LOG_VERSION);
+		fflush(file);
+		return EXIT_SUCCESS;
+	}
+	
+	
+	void InputRecorder::write(const char* type, const processor_state& state) {
+		fprintf(file, "%s %" PRIu64 " %" PRIu64, type, state.insns, state.cycles);
+	}
+	
+	void InputRecorder::recordSeed(uint64_t seed, RandomKind random) {
+		fprintf(file, "seed %" PRIu64 " %s\n", seed, getRandomKindName(random));
+		fflush(file);
+	}
+	
+	void InputRecorder::recordKey(const processor_state& state, uint8_t key) {
+		write("key", state);
+		fprintf(file, " %02x\n", key);
+		fflush(file);
+	}
+	
+	void InputRecorder::recordRewind(const processor_state& state) {
+		write("rewind", state);
+		fputc('\n', file);
+		fflush(file);
+	}
+	
+	void InputRecorder::recordStop(const processor_state& state) {
+		write("stop", state);
+		fputc('\n', file);
+		fflush(file);
+	}
+}
@@ -1,9 +1,9 @@
 #include "insn.h"
+#include "lexer.h"
 #include "error_codes.h"
 #include "util.h"
 #include <string>
 #include <map>
-#include <regex>
 #include <cstring>
 #include <cstdarg>
 #include <cassert>
@@ -13,38 +13,32 @@ namespace int6502 {
 	using std::string;
 	using std::vector;
 	using std::map;
-	
-	using std::regex;
-	using std::smatch;
-	using std::regex_match;
 
 	
 	
-	inline int numberTooLargeError(int lineNum, const char* value) {
-		return syntaxError(lineNum, "Number \"%s\" is too large", value);
+	inline int numberTooLargeError(int lineNum, int column, const char* value) {
+		return syntaxErrorAt(lineNum, column, "Number \"%s\" is too large", value);
 	}
 	
-	inline int invalidNumberError(int lineNum, const char* value) {
-		return syntaxError(lineNum, "Invalid number \"%s\"", value);
+	inline int invalidNumberError(int lineNum, int column, const char* value) {
+		return syntaxErrorAt(lineNum, column, "Invalid number \"%s\"", value);
 	}
 	
-	inline int addressingModeNotSupported(int lineNum, const char* insn) {
-		return syntaxError(lineNum, "This addressing mode is not supported by \"%s\" instruction", insn);
+	inline int addressingModeNotSupported(int lineNum, int column, const char* insn) {
+		return syntaxErrorAt(lineNum, column, "This addressing mode is not supported by \"%s\" instruction", insn);
 	}
 	
-	inline int labelTooFar(int lineNum, const char* label) {
-		return syntaxError(lineNum, "Label \"%s\" is too far", label);
+	inline int labelTooFar(int lineNum, int column, const char* label) {
+		return syntaxErrorAt(lineNum, column, "Label \"%s\" is too far", label);
 	}
 	
-	inline int noOperandError(int lineNum) {
-		return syntaxError(lineNum, "Expected operand");
+	inline int noOperandError(int lineNum, int column) {
+		return syntaxErrorAt(lineNum, column, "Expected operand");
 	}
 	
 	
-	static uint8_t EMPTY_VAR;
-	#define VOID &EMPTY_VAR
-	
-	int parseInt(const char* str, int lineNum, uint16_t* res, uint8_t* size) {
+	// column - столбец числа в исходнике для сообщений об ошибках
+	int parseInt(const char* str, int lineNum, int column, uint16_t* res, uint8_t* size) {
 		const char* const srcStr = str;
 		
 		int base = 10;
@@ -54,15 +48,15 @@ namespace int6502 {
 			base = 16;
 			
 			switch (strlen(str)) {
-				case 0: return invalidNumberError(lineNum, srcStr);
+				case 0: return invalidNumberError(lineNum, column, srcStr);
 				case 1: case 2: *size = 1; break;
 				case 3: case 4: *size = 2; break;
-				default: return numberTooLargeError(lineNum, srcStr);
+				default: return numberTooLargeError(lineNum, column, srcStr);
 			}
 		}
 		
 		if (str[0] == '\0') {
-			return invalidNumberError(lineNum, srcStr);
+			return invalidNumberError(lineNum, column, srcStr);
 		}
 		
 		int num = 0;
@@ -78,15 +72,15 @@ namespace int6502 {
 				digit = c - 'a' + 10;
 				
 			} else {
-				return invalidNumberError(lineNum, srcStr);
+				return invalidNumberError(lineNum, column, srcStr);
 			}
 			
 			num = num * base + digit;
-		}
-		
-		
-		if (uint16_t(num) != num) {
-			return numberTooLargeError(lineNum, srcStr);
+			
+			// Дальнейшие цифры число уже не уменьшат
+			if (num > 0xFFFF) {
+				return numberTooLargeError(lineNum, column, srcStr);
+			}
 		}
 		
 		if (base == 10) {
@@ -101,27 +95,8 @@ namespace int6502 {
 	// ------------------------------------------------------------------- Labels -------------------------------------------------------------------
 		
 		
-	enum class AddrMode {
-		REL, // one-byte signed address
-		ABS, // two-byte unsigned address
-	};
-	
-	struct RequiredLabel {
-		size_t pos;
-		AddrMode mode;
-		int lineNum;
-		string label;
-		
-		RequiredLabel(size_t pos, AddrMode mode, int lineNum, const string& label):
-				pos(pos), mode(mode), lineNum(lineNum), label(label) {}
-	};
-	
-	
-	static vector<RequiredLabel> requiredLabels;
-	
-	
-	void addRequiredLabel(AddrMode mode, int lineNum, const string& label, vector<uint8_t>& code) {
-		requiredLabels.emplace_back(code.size(), mode, lineNum, label);
+	void addRequiredLabel(AssemblerState& state, AddrMode mode, int lineNum, int column, Symbol label, vector<uint8_t>& code) {
+		state.requiredLabels.emplace_back(code.size(), mode, lineNum, column, label);
 		
 		code.push_back(0x00);
 		
@@ -129,23 +104,26 @@ namespace int6502 {
 			code.push_back(0x00);
 	}
 	
-	void addRequiredLabel(AddrMode mode, int lineNum, const string& label, vector<uint8_t>& code, uint8_t opcode) {
+	void addRequiredLabel(AssemblerState& state, AddrMode mode, int lineNum, int column, Symbol label, vector<uint8_t>& code, uint8_t opcode) {
 		code.push_back(opcode);
-		addRequiredLabel(mode, lineNum, label, code);
+		addRequiredLabel(state, mode, lineNum, column, label, code);
 	}
 	
 	
-	int initLabels(vector<uint8_t>& code, map<string, size_t>& labels) {
-		for (const RequiredLabel& req : requiredLabels) {
-			auto found = labels.find(req.label);
+	int initLabels(vector<uint8_t>& code, const AssemblerState& state) {
+		const SymbolTable& symbols = state.symbols;
+		
+		for (const RequiredLabel& req : state.requiredLabels) {
+			const size_t found = symbols.getLabel(req.label);
+			const char* const name = symbols.getName(req.label);
 			
-			if (found != labels.end()) {
+			if (found != SymbolTable::NO_LABEL) {
 				switch (req.mode) {
 					case AddrMode::REL: {
-						int16_t offset = int16_t(found->second - req.pos - 1);
+						int16_t offset = int16_t(found - req.pos - 1);
 				
 						if (int8_t(offset) != offset) {
-							return labelTooFar(req.lineNum, req.label.c_str());
+							return labelTooFar(req.lineNum, req.column, name);
 						}
 						
 						code[req.pos] = uint8_t(offset);
@@ -153,10 +131,10 @@ namespace int6502 {
 					}
 					
 					case AddrMode::ABS: {
-						size_t addr = CODE_POS + found->second;
+						size_t addr = CODE_POS + found;
 						
 						if (uint16_t(addr) != addr) {
-							return labelTooFar(req.lineNum, req.label.c_str());
+							return labelTooFar(req.lineNum, req.column, name);
 						}
 						
 						code[req.pos]   = uint8_t(addr);
@@ -169,7 +147,7 @@ namespace int6502 {
 				}
 				
 			} else {
-				return syntaxError(req.lineNum, "Label \"%s\" not found", req.label.c_str());
+				return syntaxErrorAt(req.lineNum, req.column, "Label \"%s\" not found", name);
 			}
 		}
 		
@@ -195,72 +173,73 @@ namespace int6502 {
 	
 	// Типы адресации: IMM, ZP, ZP+X, ZP+Y, ABS, ABS+X, ABS+Y, IND X, IND Y
 	int insn(
-			const string& operation, const string& operand, const DefineTable& defineTable, int lineNum, vector<uint8_t>& code,
+			const string& operation, const string& operand, AssemblerState& state, int lineNum, vector<uint8_t>& code,
 			uint8_t imm, uint8_t zp, uint8_t zpX, uint8_t zpY, uint8_t abs, uint8_t absX, uint8_t absY, uint8_t indX, uint8_t indY, uint8_t regA
 	) {
+		const int column = state.operandColumn;
+		
 		if (operand.empty()) {
-			return noOperandError(lineNum);
+			return noOperandError(lineNum, column);
 		}
 		
-		const string& str = defineTable[operand];
-		
-		if (str == "a" || str == "A") {
-			Insn insn(regA, 1);
-			
-			if (insn.isNull()) {
-				return addressingModeNotSupported(lineNum, operation.c_str());
-			}
-			
-			code.push_back(insn.opcode);
-			return EXIT_SUCCESS;
-		}
+		Operand parsed;
 		
+		int res = parseOperand(operand, lineNum, column, parsed);
+		if (res != EXIT_SUCCESS) return res;
 		
-		#define WORD "([$\\w_]+)"
-		#define SPACE "\\s*"
-		static const regex immediateRegex ("#" WORD);
-		static const regex commonRegex    (WORD "(?:" SPACE "," SPACE "([xyXY])" SPACE ")?");
-		static const regex indirectXRegex ("\\(" SPACE WORD SPACE "," SPACE "[xX]" SPACE "\\)");
-		static const regex indirectYRegex ("\\(" SPACE WORD SPACE "\\)" SPACE "," SPACE "[yY]");
-		#undef SPACE
-		#undef WORD
+		SymbolTable& symbols = state.symbols;
+		const Symbol defined = symbols.resolve(symbols.intern(operand.data() + parsed.value.pos, parsed.value.length));
+		const char* const definedName = symbols.getName(defined);
 		
 		Insn insn1(NULL_OPR, 0),
 			 insn2(NULL_OPR, 0);
 		
-		string value;
-		
-		smatch match;
-		
-		if (regex_match(operand, match, immediateRegex)) {
-			insn1 = Insn(imm, 2);
-			value = match[1].str();
+		switch (parsed.kind) {
+			case OperandKind::IMMEDIATE:
+				insn1 = Insn(imm, 2);
+				break;
+			
+			case OperandKind::DIRECT:
+				if (symbols.getLength(defined) == 1 && std::tolower(definedName[0]) == 'a') {
+					Insn insn(regA, 1);
+					
+					if (insn.isNull()) {
+						return addressingModeNotSupported(lineNum, column, operation.c_str());
+					}
+					
+					code.push_back(insn.opcode);
+					return EXIT_SUCCESS;
+				}
+				
+				insn1 = Insn(zp, 2);
+				insn2 = Insn(abs, 3);
+				break;
 			
-		} else if (regex_match(operand, match, commonRegex)) {
-			value = match[1].str();
-			string xy = match[2].str();
-			tolower(xy);
+			case OperandKind::INDEXED_X:
+				insn1 = Insn(zpX, 2);
+				insn2 = Insn(absX, 3);
+				break;
 			
-			insn1 = Insn(xy == "x" ? zpX  : xy == "y" ? zpY  : zp,  2);
-			insn2 = Insn(xy == "x" ? absX : xy == "y" ? absY : abs, 3);
-		
-		} else if (regex_match(operand, match, indirectXRegex)) {
-			insn1 = Insn(indX, 2);
-			value = match[1];
+			case OperandKind::INDEXED_Y:
+				insn1 = Insn(zpY, 2);
+				insn2 = Insn(absY, 3);
+				break;
+			
+			case OperandKind::INDIRECT_X:
+				insn1 = Insn(indX, 2);
+				break;
 			
-		} else if (regex_match(operand, match, indirectYRegex)) {
-			insn1 = Insn(indY, 2);
-			value = match[1];
+			case OperandKind::INDIRECT_Y:
+				insn1 = Insn(indY, 2);
+				break;
 			
-		} else {
-			return invalidSyntaxError(lineNum);
+			case OperandKind::INDIRECT:
+				return addressingModeNotSupported(lineNum, column, operation.c_str());
 		}
 		
 		
-		const string& defined = defineTable[value];
-		
-		if (isValidLabel(defined) && !insn2.isNull()) {
-			addRequiredLabel(AddrMode::ABS, lineNum, defined, code, insn2.opcode);
+		if (symbols.isLabelName(defined) && !insn2.isNull()) {
+			addRequiredLabel(state, AddrMode::ABS, lineNum, parsed.column, defined, code, insn2.opcode);
 			return EXIT_SUCCESS;
 		}
 		
@@ -268,13 +247,13 @@ namespace int6502 {
 		uint16_t num;
 		uint8_t size;
 		
-		int res = parseInt(defined.c_str(), lineNum, &num, &size);
+		res = parseInt(definedName, lineNum, parsed.column, &num, &size);
 		if (res != EXIT_SUCCESS) return res;
 		
 		Insn& insn = size == 1 ? insn1 : insn2;
 		
 		if (insn.isNull()) {
-			return addressingModeNotSupported(lineNum, operation.c_str());
+			return addressingModeNotSupported(lineNum, column, operation.c_str());
 		}
 		
 		
@@ -289,9 +268,9 @@ namespace int6502 {
 	
 	
 	
-	int noOpsInsn(const string& operation, const string& operand, int lineNum, vector<uint8_t>& code, uint8_t opcode) {
+	int noOpsInsn(const string& operation, const string& operand, AssemblerState& state, int lineNum, vector<uint8_t>& code, uint8_t opcode) {
 		if (!operand.empty()) {
-			return syntaxError(lineNum, "Too many operands for \"%s\" instruction", operation.c_str());
+			return syntaxErrorAt(lineNum, state.operandColumn, "Too many operands for \"%s\" instruction", operation.c_str());
 		}
 		
 		code.push_back(opcode);
@@ -299,52 +278,66 @@ namespace int6502 {
 	}
 	
 	
-	int labelInsn(const string& operand, const DefineTable& defineTable, int lineNum, vector<uint8_t>& code, uint8_t opcode, AddrMode mode) {
+	int labelInsn(const string& operand, AssemblerState& state, int lineNum, vector<uint8_t>& code, uint8_t opcode, AddrMode mode) {
 		if (operand.empty()) {
-			return noOperandError(lineNum);
+			return noOperandError(lineNum, state.operandColumn);
 		}
 		
-		const string& label = defineTable[operand];
+		Operand parsed;
 		
-		if (!isValidLabel(label)) {
-			return syntaxError(lineNum, "Invalid label name: \"%s\"", label.c_str());
+		int res = parseOperand(operand, lineNum, state.operandColumn, parsed);
+		if (res != EXIT_SUCCESS) return res;
+		
+		SymbolTable& symbols = state.symbols;
+		const Symbol label = symbols.resolve(symbols.intern(operand.data() + parsed.value.pos, parsed.value.length));
+		
+		if (parsed.kind != OperandKind::DIRECT || !symbols.isLabelName(label)) {
+			return syntaxErrorAt(lineNum, state.operandColumn, "Invalid label name: \"%s\"", operand.c_str());
 		}
 		
-		addRequiredLabel(mode, lineNum, label, code, opcode);
+		addRequiredLabel(state, mode, lineNum, parsed.column, label, code, opcode);
 		
 		return EXIT_SUCCESS;
 	}
 	
 	
-	int jmpInsn(const string& rawOperand, const DefineTable& defineTable, int lineNum, vector<uint8_t>& code, uint8_t abs, uint8_t ind) {
-		if (rawOperand.empty()) {
-			return noOperandError(lineNum);
+	int jmpInsn(const string& operand, AssemblerState& state, int lineNum, vector<uint8_t>& code, uint8_t abs, uint8_t ind) {
+		if (operand.empty()) {
+			return noOperandError(lineNum, state.operandColumn);
 		}
 		
-		const string& operand = defineTable[rawOperand];
+		Operand parsed;
 		
-		if (isValidLabel(operand)) {
-			addRequiredLabel(AddrMode::ABS, lineNum, operand, code, abs);
-			
-			return EXIT_SUCCESS;
-		}
+		int res = parseOperand(operand, lineNum, state.operandColumn, parsed);
+		if (res != EXIT_SUCCESS) return res;
 		
-		string value;
-		uint8_t opcode;
+		SymbolTable& symbols = state.symbols;
+		const Symbol value = symbols.resolve(symbols.intern(operand.data() + parsed.value.pos, parsed.value.length));
 		
-		size_t last = operand.size() - 1;
+		uint8_t opcode;
 		
-		if (operand[0] == '(' && operand[last] == ')') {
-			value = operand.substr(1, last - 1);
-			opcode = ind;
-		} else {
-			value = operand;
-			opcode = abs;
+		switch (parsed.kind) {
+			case OperandKind::DIRECT:
+				if (symbols.isLabelName(value)) {
+					addRequiredLabel(state, AddrMode::ABS, lineNum, parsed.column, value, code, abs);
+					return EXIT_SUCCESS;
+				}
+				
+				opcode = abs;
+				break;
+			
+			case OperandKind::INDIRECT:
+				opcode = ind;
+				break;
+			
+			default:
+				return addressingModeNotSupported(lineNum, state.operandColumn, "jmp");
 		}
 		
 		uint16_t num;
+		uint8_t size;
 		
-		int res = parseInt(value.c_str(), lineNum, &num, VOID);
+		res = parseInt(symbols.getName(value), lineNum, parsed.column, &num, &size);
 		if (res != EXIT_SUCCESS) return res;
 		
 		code.push_back(opcode);
@@ -355,57 +348,81 @@ namespace int6502 {
 	}
 	
 	
-	int dcbInsn(const string& operand, const DefineTable& defineTable, int lineNum, vector<uint8_t>& code) {
+	// Грамматика: WORD (',' WORD)*
+	int dcbInsn(const string& operand, AssemblerState& state, int lineNum, vector<uint8_t>& code) {
+		const int column = state.operandColumn;
+		
 		if (operand.empty())
-			return noOperandError(lineNum);
+			return noOperandError(lineNum, column);
 		
+		SymbolTable& symbols = state.symbols;
+		Lexer lexer(operand);
 		
-		for (size_t i = 0, next = 0; next != string::npos; i = next + 1) {
-			next = operand.find(',', i);
-			
-			string val = operand.substr(i, next == string::npos ? string::npos : next - i);
-			trim(val);
+		for (Token token = lexer.next(); ; token = lexer.next()) {
+			if (token.kind != TokenKind::WORD) {
+				return syntaxErrorAt(lineNum, column + int(token.pos), "Expected number or name");
+			}
 			
-			const string& defined = defineTable[val];
+			const int valueColumn = column + int(token.pos);
+			const Symbol defined = symbols.resolve(symbols.intern(operand.data() + token.pos, token.length));
 			
-			if (isValidLabel(defined)) {
-				addRequiredLabel(AddrMode::ABS, lineNum, defined, code);
-				continue;
+			if (symbols.isLabelName(defined)) {
+				addRequiredLabel(state, AddrMode::ABS, lineNum, valueColumn, defined, code);
+				
+			} else {
+				uint16_t num;
+				uint8_t size;
+				
+				int res = parseInt(symbols.getName(defined), lineNum, valueColumn, &num, &size);
+				if (res != EXIT_SUCCESS)
+					return res;
+				
+				code.push_back(uint8_t(num));
+				
+				if (size == 2)
+					code.push_back(uint8_t(num >> 8));
 			}
 			
-			uint16_t num;
-			uint8_t size;
+			token = lexer.next();
 			
-			int res = parseInt(defined.c_str(), lineNum, &num, &size);
-			if (res != EXIT_SUCCESS)
-				return res;
+			if (token.kind == TokenKind::END)
+				return EXIT_SUCCESS;
 			
-			code.push_back(uint8_t(num));
-			
-			if (size == 2)
-				code.push_back(uint8_t(num >> 8));
+			if (token.kind != TokenKind::COMMA) {
+				return syntaxErrorAt(lineNum, column + int(token.pos), "Expected \",\" or end of line");
+			}
 		}
-		
-		return EXIT_SUCCESS;
 	}
 	
 	
-	int defineInsn(const string& operand, DefineTable& defineTable, int lineNum) {
+	// Грамматика: NAME WORD, где NAME - допустимое имя лейбла
+	int defineInsn(const string& operand, AssemblerState& state, int lineNum) {
+		const int column = state.operandColumn;
+		
 		if (operand.empty())
-			return noOperandError(lineNum);
+			return noOperandError(lineNum, column);
 		
+		Lexer lexer(operand);
 		
-		static const regex rgx("([a-zA-Z_][\\w_]*)\\s+([$\\w_]+)");
+		const Token name = lexer.next();
+		const Token value = lexer.next();
+		const Token end = lexer.next();
 		
-		smatch match;
+		if (name.kind != TokenKind::WORD || !isValidLabel(operand.data() + name.pos, name.length)) {
+			return syntaxErrorAt(lineNum, column + int(name.pos), "Expected name");
+		}
 		
-		if (regex_match(operand, match, rgx)) {
-			defineTable[match[1].str()] = match[2].str();
-			return EXIT_SUCCESS;
-			
-		} else {
-			return invalidSyntaxError(lineNum);
+		if (value.kind != TokenKind::WORD) {
+			return syntaxErrorAt(lineNum, column + int(value.pos), "Expected value");
 		}
+		
+		if (end.kind != TokenKind::END) {
+			return syntaxErrorAt(lineNum, column + int(end.pos), "Expected end of line");
+		}
+		
+		SymbolTable& symbols = state.symbols;
+		symbols.define(symbols.intern(operand.data() + name.pos, name.length), symbols.intern(operand.data() + value.pos, value.length));
+		return EXIT_SUCCESS;
 	}
 	
 	
@@ -417,45 +434,45 @@ namespace int6502 {
 			uint8_t indX = NULL_OPR, uint8_t indY = NULL_OPR,
 			uint8_t regA = NULL_OPR
 	) {
-		return [=] (const string& operation, const string& operand, DefineTable& defineTable, int lineNum, auto& code) {
-			return insn(operation, operand, defineTable, lineNum, code, imm, zp, zpX, zpY, abs, absX, absY, indX, indY, regA);
+		return [=] (const string& operation, const string& operand, AssemblerState& state, int lineNum, auto& code) {
+			return insn(operation, operand, state, lineNum, code, imm, zp, zpX, zpY, abs, absX, absY, indX, indY, regA);
 		};
 	}
 	
 	static InsnFunction getRegAInsnFunction(uint8_t regA, uint8_t zp, uint8_t zpX, uint8_t abs, uint8_t absX) {
 		
-		return [=] (const auto& operation, const auto& operand, DefineTable& defineTable, int lineNum, auto& code) {
-			return insn(operation, operand, defineTable, lineNum, code, NULL_OPR, zp, zpX, NULL_OPR, abs, absX, NULL_OPR, NULL_OPR, NULL_OPR, regA);
+		return [=] (const auto& operation, const auto& operand, AssemblerState& state, int lineNum, auto& code) {
+			return insn(operation, operand, state, lineNum, code, NULL_OPR, zp, zpX, NULL_OPR, abs, absX, NULL_OPR, NULL_OPR, NULL_OPR, regA);
 		};
 	}
 	
 	static InsnFunction getNoOpsInsnFunction(uint8_t opcode) {
-		return [=] (const auto& operation, const auto& operand, DefineTable&, int lineNum, auto& code) {
-			return noOpsInsn(operation, operand, lineNum, code, opcode);
+		return [=] (const auto& operation, const auto& operand, AssemblerState& state, int lineNum, auto& code) {
+			return noOpsInsn(operation, operand, state, lineNum, code, opcode);
 		};
 	}
 	
 	static InsnFunction getLabelInsnFunction(uint8_t opcode, AddrMode mode) {
-		return [=] (const auto&, const auto& operand, DefineTable& defineTable, int lineNum, auto& code) {
-			return labelInsn(operand, defineTable, lineNum, code, opcode, mode);
+		return [=] (const auto&, const auto& operand, AssemblerState& state, int lineNum, auto& code) {
+			return labelInsn(operand, state, lineNum, code, opcode, mode);
 		};
 	}
 	
 	static InsnFunction getJmpInsnFunction(uint8_t abs, uint8_t ind) {
-		return [=] (const auto&, const auto& operand, DefineTable& defineTable, int lineNum, auto& code) {
-			return jmpInsn(operand, defineTable, lineNum, code, abs, ind);
+		return [=] (const auto&, const auto& operand, AssemblerState& state, int lineNum, auto& code) {
+			return jmpInsn(operand, state, lineNum, code, abs, ind);
 		};
 	}
 	
 	static InsnFunction getDcbInsnFunction() {
-		return [=] (const auto&, const auto& operand, DefineTable& defineTable, int lineNum, auto& code) {
-			return dcbInsn(operand, defineTable, lineNum, code);
+		return [=] (const auto&, const auto& operand, AssemblerState& state, int lineNum, auto& code) {
+			return dcbInsn(operand, state, lineNum, code);
 		};
 	}
 	
 	static InsnFunction getDefineInsnFunction() {
-		return [=] (const auto&, const auto& operand, DefineTable& defineTable, int lineNum, auto&) {
-			return defineInsn(operand, defineTable, lineNum);
+		return [=] (const auto&, const auto& operand, AssemblerState& state, int lineNum, auto&) {
+			return defineInsn(operand, state, lineNum);
 		};
 	}
 	
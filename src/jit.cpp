@@ -0,0 +1,1340 @@
+#include "jit.h"
+#include "decoder.h"
+#include "opcodes.h"
+#include "insn.h"
+#include "bus.h"
+#include <cstdlib>
+
+#if defined(__x86_64__) && defined(__unix__)
+	#define JIT_SUPPORTED 1
+#else
+	#define JIT_SUPPORTED 0
+#endif
+
+#if JIT_SUPPORTED
+	#include <chrono>
+	#include <vector>
+	#include <cstddef>
+	#include <cstring>
+	#include <algorithm>
+	#include <initializer_list>
+	#include <sys/mman.h>
+#endif
+
+namespace int6502 {
+	
+#if JIT_SUPPORTED
+	
+	// ------------------------------------------------------------------ Emitter -------------------------------------------------------------------
+	
+	enum Reg : uint8_t {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8,  R9,  R10, R11, R12, R13, R14, R15,
+		NO_REG = 0xFF
+	};
+	
+	// Операции вида "op r/m32, r32" и "op r/m32, imm32" (номер совпадает с /digit для опкода 0x81)
+	enum Alu : uint8_t {
+		ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7
+	};
+	
+	enum Cond : uint8_t {
+		CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC
+	};
+	
+	// Операнд в памяти: [base + index * (1 << scale) + disp]
+	struct Mem {
+		Reg base;
+		Reg index;
+		int32_t disp;
+		uint8_t scale;
+		
+		Mem(Reg base, int32_t disp):
+				base(base), index(NO_REG), disp(disp), scale(0) {}
+		
+		Mem(Reg base, Reg index, int32_t disp, uint8_t scale = 0):
+				base(base), index(index), disp(disp), scale(scale) {}
+	};
+	
+	
+	// Записывает машинный код x86-64 в буфер. Поддерживается только небольшое
+	// подмножество инструкций, необходимое для трансляции 6502.
+	class Emitter {
+		uint8_t* const buf;
+		const size_t size;
+		size_t pos = 0;
+		bool overflow = false;
+		
+		void rex(bool w, int reg, int index, int base, bool force) {
+			uint8_t rex = uint8_t(0x40 | w << 3 | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1));
+			
+			if (rex != 0x40 || force) {
+				byte(rex);
+			}
+		}
+		
+		// force - для доступа к младшим байтам SPL, BPL, SIL, DIL требуется префикс REX
+		void opReg(std::initializer_list<uint8_t> op, int reg, Reg rm, bool w = false, bool force = false) {
+			rex(w, reg, 0, rm, force);
+			for (uint8_t b : op) byte(b);
+			byte(uint8_t(0xC0 | (reg & 7) << 3 | (rm & 7)));
+		}
+		
+		// Всегда кодируется через SIB и disp32, чтобы не обрабатывать особые случаи RSP/RBP/R12/R13
+		void opMem(std::initializer_list<uint8_t> op, int reg, const Mem& mem, bool w = false, bool force = false) {
+			rex(w, reg, mem.index == NO_REG ? 0 : mem.index, mem.base, force);
+			for (uint8_t b : op) byte(b);
+			byte(uint8_t(0x80 | (reg & 7) << 3 | 4));
+			byte(uint8_t(mem.scale << 6 | (mem.index == NO_REG ? 4 : mem.index & 7) << 3 | (mem.base & 7)));
+			dword(uint32_t(mem.disp));
+		}
+	
+	public:
+		Emitter(uint8_t* buf, size_t size):
+				buf(buf), size(size) {}
+		
+		uint8_t* cur() const { return buf + pos; }
+		
+		bool failed() const { return overflow; }
+		
+		void byte(uint8_t val) {
+			if (pos < size) {
+				buf[pos++] = val;
+			} else {
+				overflow = true;
+			}
+		}
+		
+		void dword(uint32_t val) {
+			for (int i = 0; i < 4; i++, val >>= 8) byte(uint8_t(val));
+		}
+		
+		void qword(uint64_t val) {
+			for (int i = 0; i < 8; i++, val >>= 8) byte(uint8_t(val));
+		}
+		
+		
+		void movImm(Reg dst, uint32_t imm)     { rex(false, 0, 0, dst, false); byte(uint8_t(0xB8 | (dst & 7))); dword(imm); }
+		void movImm64(Reg dst, uint64_t imm)   { rex(true,  0, 0, dst, false); byte(uint8_t(0xB8 | (dst & 7))); qword(imm); }
+		void mov(Reg dst, Reg src)             { opReg({0x89}, src, dst); }
+		void mov64(Reg dst, Reg src)           { opReg({0x89}, src, dst, true); }
+		
+		void alu(Alu op, Reg dst, Reg src)     { opReg({uint8_t(op << 3 | 1)}, src, dst); }
+		void aluImm(Alu op, Reg dst, int32_t imm) { opReg({0x81}, op, dst); dword(uint32_t(imm)); }
+		void alu64Imm(Alu op, Reg dst, int32_t imm) { opReg({0x81}, op, dst, true); dword(uint32_t(imm)); }
+		void alu64MemImm(Alu op, const Mem& mem, int32_t imm) { opMem({0x81}, op, mem, true); dword(uint32_t(imm)); }
+		void alu64Mem(Alu op, const Mem& mem, Reg src) { opMem({uint8_t(op << 3 | 1)}, src, mem, true); }
+		void cmpMem8Imm(const Mem& mem, uint8_t imm) { opMem({0x80}, CMP, mem); byte(imm); }
+		
+		void shl(Reg dst, uint8_t n)           { opReg({0xC1}, 4, dst); byte(n); }
+		void shr(Reg dst, uint8_t n)           { opReg({0xC1}, 5, dst); byte(n); }
+		void testImm(Reg dst, uint32_t imm)    { opReg({0xF7}, 0, dst); dword(imm); }
+		void test(Reg dst, Reg src)            { opReg({0x85}, src, dst); }
+		void test64(Reg dst, Reg src)          { opReg({0x85}, src, dst, true); }
+		void setcc(Cond cond, Reg dst)         { opReg({0x0F, uint8_t(0x90 | cond)}, 0, dst, false, true); }
+		
+		void load8(Reg dst, const Mem& mem)    { opMem({0x0F, 0xB6}, dst, mem); }
+		void store8(const Mem& mem, Reg src)   { opMem({0x88}, src, mem, false, true); }
+		void store8Imm(const Mem& mem, uint8_t imm) { opMem({0xC6}, 0, mem); byte(imm); }
+		void load32(Reg dst, const Mem& mem)   { opMem({0x8B}, dst, mem); }
+		void store32(const Mem& mem, Reg src)  { opMem({0x89}, src, mem); }
+		void load64(Reg dst, const Mem& mem)   { opMem({0x8B}, dst, mem, true); }
+		void store64(const Mem& mem, Reg src)  { opMem({0x89}, src, mem, true); }
+		
+		void push(Reg reg)                     { rex(false, 0, 0, reg, false); byte(uint8_t(0x50 | (reg & 7))); }
+		void pop(Reg reg)                      { rex(false, 0, 0, reg, false); byte(uint8_t(0x58 | (reg & 7))); }
+		void call(Reg reg)                     { opReg({0xFF}, 2, reg); }
+		void jmp(Reg reg)                      { opReg({0xFF}, 4, reg); }
+		void jmpMem(const Mem& mem)            { opMem({0xFF}, 4, mem); }
+		void ret()                             { byte(0xC3); }
+		
+		// Возвращают указатель на rel32 для последующего связывания
+		uint8_t* jmpRel()                      { byte(0xE9); dword(0); return cur() - 4; }
+		uint8_t* jccRel(Cond cond)             { byte(0x0F); byte(uint8_t(0x80 | cond)); dword(0); return cur() - 4; }
+		
+		// Направляет переход с rel32 по адресу site на target
+		static void link(uint8_t* site, const uint8_t* target) {
+			int32_t rel = int32_t(target - (site + 4));
+			memcpy(site, &rel, sizeof(rel));
+		}
+		
+		// Направляет переход на текущую позицию
+		void bind(uint8_t* site) {
+			if (!overflow) link(site, cur());
+		}
+		
+		void jmpTo(const uint8_t* target) {
+			uint8_t* site = jmpRel();
+			if (!overflow) link(site, target);
+		}
+	};
+	
+	
+	// ----------------------------------------------------------------- Context ------------------------------------------------------------------
+	
+	// Состояние, которое скомпилированный код сохраняет при выходе и загружает при входе.
+	// Флаги N и Z хранятся лениво: Z = (nz & 0xFF) == 0, N = (nz & 0x8080) != 0.
+	struct JitContext {
+		uint32_t a, x, y, sp;
+		uint32_t nz, c, v;
+		uint8_t b, d, i;
+		uint32_t pc;
+		int64_t budget;      // Сколько ещё инструкций можно выполнить
+		uint64_t cycles;
+		uint8_t* mem;
+		void* link;          // Link, через который произошёл выход, или NULL
+		uint32_t invalidated; // Блоки были сброшены во время записи в память
+		Jit::Impl* impl;
+	};
+	
+	#define CTX(field) Mem(REG_CTX, int32_t(offsetof(JitContext, field)))
+	
+	
+	// Распределение регистров: регистры 6502 живут в регистрах хоста на протяжении всего
+	// выполнения скомпилированного кода, в том числе при переходе между блоками.
+	static const Reg
+			REG_A   = RBX,
+			REG_X   = RBP,
+			REG_Y   = R14,
+			REG_NZ  = R15,
+			REG_MEM = R12,
+			REG_CTX = R13,
+			REG_SP  = R8,  // R8-R10 сохраняются вручную при вызове функций
+			REG_C   = R9,
+			REG_V   = R10;
+	
+	static const size_t
+			CODE_BUFFER_SIZE = 16 << 20,
+			MAX_BLOCK_INSNS  = 64;
+	
+	
+	struct Block;
+	
+	// Выход из блока на известный адрес. Может быть связан напрямую с целевым блоком
+	struct Link {
+		uint8_t* site;          // rel32 перехода
+		uint8_t* stub;          // Код выхода в диспетчер
+		uint16_t target;
+		Block* patched = nullptr;
+		
+		Link(uint8_t* site, uint16_t target):
+				site(site), stub(nullptr), target(target) {}
+	};
+	
+	struct Block {
+		uint16_t start;
+		uint32_t end;           // Адрес после последней инструкции
+		uint32_t count;         // Количество инструкций
+		uint8_t* entry;         // NULL, если первая инструкция не поддерживается
+		std::vector<std::unique_ptr<Link>> links;
+		std::vector<Link*> incoming;
+	};
+	
+	
+	struct Jit::Impl : DecodeCache::Listener {
+		Bus& bus;
+		uint8_t* const mem;
+		DecodeCache& cache;
+		
+		uint8_t* code = nullptr;
+		unsigned writers = 0; // Вложенность CodeWriter: пока не 0, буфер кода доступен для записи, но не для выполнения
+		size_t codeStart = 0; // Начало области для блоков (до неё - общий код)
+		size_t codeUsed = 0;
+		uint64_t flushes = 0;
+		
+		void (*enter)(JitContext*, const void*) = nullptr;
+		uint8_t* exitCommon = nullptr;
+		uint8_t* exitIndirect = nullptr;
+		
+		std::vector<const void*> entries; // Точки входа для косвенных переходов
+		std::vector<std::unique_ptr<Block>> blocks;
+		std::vector<Block*> pages[0x100];
+		std::vector<std::unique_ptr<Block>> dead;
+		
+		JitContext ctx;
+		JitStats stats;
+		
+		Impl(Bus& bus, DecodeCache& cache);
+		~Impl();
+		
+		void onInvalidate(uint16_t addr) override;
+		
+		void emitCommon();
+		void flush();
+		void invalidate(Block* block);
+		void patch(Link* link, Block* target);
+		Block* getBlock(uint16_t pc);
+		std::unique_ptr<Block> compile(uint16_t pc);
+		
+		void loadContext(const processor_state& state);
+		void storeContext(processor_state* state) const;
+		int run(processor_state* state, uint64_t limit);
+	};
+	
+	
+	// Открывает буфер кода на запись на время своего существования. Буфер никогда не бывает
+	// одновременно доступен для записи и выполнения (W^X): при записи он недоступен для выполнения,
+	// поэтому машинный код между созданием и уничтожением CodeWriter не вызывается
+	class CodeWriter {
+		Jit::Impl& impl;
+	
+	public:
+		explicit CodeWriter(Jit::Impl& impl): impl(impl) {
+			if (impl.writers++ == 0) {
+				mprotect(impl.code, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE);
+			}
+		}
+		
+		~CodeWriter() {
+			if (--impl.writers == 0) {
+				mprotect(impl.code, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC);
+			}
+		}
+		
+		CodeWriter(const CodeWriter&) = delete;
+	};
+	
+	
+	// ----------------------------------------------------------------- Helpers ------------------------------------------------------------------
+	
+	// Чтение с устройства. Возвращает значение | addr << 16
+	static uint32_t helperBusRead(JitContext* ctx, uint32_t addr) {
+		return ctx->impl->bus.read(uint16_t(addr)) | addr << 16;
+	}
+	
+	// Запись на устройство. arg - адрес | значение << 16, возвращает адрес
+	static uint32_t helperBusWrite(JitContext* ctx, uint32_t arg) {
+		ctx->impl->bus.write(uint16_t(arg), uint8_t(arg >> 16));
+		return arg & 0xFFFF;
+	}
+	
+	// Вызывается после записи в страницу, из которой декодировался код.
+	// Возвращает ненулевое значение, если какой-либо блок был сброшен
+	static uint32_t helperWrite(JitContext* ctx, uint32_t addr) {
+		ctx->impl->cache.onWrite(uint16_t(addr));
+		
+		uint32_t invalidated = ctx->invalidated;
+		ctx->invalidated = 0;
+		return invalidated;
+	}
+	
+	
+	// ----------------------------------------------------------------- Compiler -----------------------------------------------------------------
+	
+	static bool isSupportedOpcode(uint8_t opcode) {
+		switch (opcode) {
+			case PHP: case PLP:
+				return false;
+			
+			default:
+				return getOpcodeInfo(opcode).size != 0;
+		}
+	}
+	
+	static bool isBlockEnd(uint8_t opcode) {
+		switch (opcode) {
+			case BEQ: case BNE: case BMI: case BPL:
+			case BCS: case BCC: case BVS: case BVC:
+			case JMP_ABS: case JMP_IND: case JSR: case RTS: case BRK:
+				return true;
+			
+			default:
+				return false;
+		}
+	}
+	
+	
+	// Транслирует один блок
+	class BlockCompiler {
+		Jit::Impl& jit;
+		Emitter& e;
+		Block& block;
+		
+		// Выходы, код которых генерируется после тела блока
+		struct PendingExit {
+			uint8_t* site;
+			uint32_t pc;
+			uint32_t refund;       // Сколько инструкций вернуть в бюджет
+			uint32_t refundCycles; // Сколько тактов вычесть
+			Link* link;            // NULL - выход без связывания
+		};
+		
+		std::vector<PendingExit> exits;
+		
+		// Базовое количество тактов инструкций блока, следующих за i-й
+		std::vector<uint32_t> cyclesAfter;
+		
+		
+		void exitTo(uint8_t* site, uint32_t pc, bool chain, uint32_t refund = 0, uint32_t refundCycles = 0) {
+			Link* link = nullptr;
+			
+			if (chain) {
+				block.links.emplace_back(new Link(site, uint16_t(pc)));
+				link = block.links.back().get();
+			}
+			
+			exits.push_back({ site, pc, refund, refundCycles, link });
+		}
+		
+		void directExit(uint16_t pc) {
+			exitTo(e.jmpRel(), pc, true);
+		}
+		
+		// Адрес перехода должен быть в EAX
+		void indirectExit() {
+			e.movImm64(RDX, uint64_t(jit.entries.data()));
+			e.jmpMem(Mem(RDX, RAX, 0, 3));
+		}
+		
+		void callHelper(uint32_t (*fn)(JitContext*, uint32_t)) {
+			e.push(R8);
+			e.push(R9);
+			e.push(R10);
+			e.alu64Imm(SUB, RSP, 8);
+			e.mov64(RDI, REG_CTX);
+			e.movImm64(RAX, uint64_t(fn));
+			e.call(RAX);
+			e.alu64Imm(ADD, RSP, 8);
+			e.pop(R10);
+			e.pop(R9);
+			e.pop(R8);
+		}
+		
+		
+		// Добавляет такт, если старшие байты EDX и EAX различаются. Портит EDX и R11
+		void pageCross() {
+			e.alu(XOR, RDX, RAX);
+			e.shr(RDX, 8);
+			e.alu(XOR, R11, R11);
+			e.test(RDX, RDX);
+			e.setcc(CC_NE, R11);
+			e.alu64Mem(ADD, CTX(cycles), R11);
+		}
+		
+		// Вычисляет адрес операнда в EAX.
+		// read - чтение, для которого пересечение границы страницы стоит такт
+		void address(Addressing mode, uint16_t op, bool read = false) {
+			switch (mode) {
+				case Addressing::ZP:
+				case Addressing::ABS:
+					e.movImm(RAX, op);
+					break;
+				
+				case Addressing::ZP_X:
+				case Addressing::ZP_Y:
+					e.mov(RAX, mode == Addressing::ZP_X ? REG_X : REG_Y);
+					e.aluImm(ADD, RAX, op);
+					e.aluImm(AND, RAX, 0xFF);
+					break;
+				
+				case Addressing::ABS_X:
+				case Addressing::ABS_Y:
+					e.mov(RAX, mode == Addressing::ABS_X ? REG_X : REG_Y);
+					e.aluImm(ADD, RAX, op);
+					e.aluImm(AND, RAX, 0xFFFF);
+					
+					if (read) {
+						e.movImm(RDX, op);
+						pageCross();
+					}
+					break;
+				
+				case Addressing::IND_X:
+					e.mov(RAX, REG_X);
+					e.aluImm(ADD, RAX, op);
+					e.aluImm(AND, RAX, 0xFF);
+					e.load8(RCX, Mem(REG_MEM, RAX, 0));
+					e.load8(RDX, Mem(REG_MEM, RAX, 1));
+					e.shl(RDX, 8);
+					e.alu(OR, RCX, RDX);
+					e.mov(RAX, RCX);
+					break;
+				
+				case Addressing::IND_Y:
+					e.load8(RCX, Mem(REG_MEM, op));
+					e.load8(RDX, Mem(REG_MEM, op + 1));
+					e.shl(RDX, 8);
+					e.alu(OR, RCX, RDX);
+					e.mov(RDX, RCX);
+					e.alu(ADD, RCX, REG_Y);
+					e.aluImm(AND, RCX, 0xFFFF);
+					e.mov(RAX, RCX);
+					
+					if (read) {
+						pageCross();
+					}
+					break;
+				
+				default:
+					break;
+			}
+		}
+		
+		static bool isConstant(Addressing mode) {
+			return mode == Addressing::ZP || mode == Addressing::ABS;
+		}
+		
+		// Возвращает true, если операнд в режиме mode может попасть на байт, отображённый на устройство.
+		// pages - таблица страниц шины для чтения или записи
+		static bool mayHook(const Bus::Page* const* pages, Addressing mode, uint16_t op) {
+			switch (mode) {
+				case Addressing::ZP_X:
+				case Addressing::ZP_Y:
+					return pages[0] != nullptr;
+				
+				case Addressing::ABS_X:
+				case Addressing::ABS_Y:
+					return pages[op >> 8] != nullptr || pages[uint16_t(op + 0xFF) >> 8] != nullptr;
+				
+				default:
+					return std::any_of(pages, pages + Bus::PAGES, [] (const Bus::Page* page) { return page != nullptr; });
+			}
+		}
+		
+		// Переходы ram выполняются, если байт по адресу из EAX - обычная память. Портит EDX и RSI
+		void jumpIfRam(const Bus::Page* const* pages, uint8_t* ram[2]) {
+			e.mov(RDX, RAX);
+			e.shr(RDX, 8);
+			e.movImm64(RSI, uint64_t(pages));
+			e.load64(RSI, Mem(RSI, RDX, 0, 3));
+			e.test64(RSI, RSI);
+			ram[0] = e.jccRel(CC_E);
+			
+			e.mov(RDX, RAX);
+			e.aluImm(AND, RDX, 0xFF);
+			e.cmpMem8Imm(Mem(RSI, RDX, 0), 0);
+			ram[1] = e.jccRel(CC_E);
+		}
+		
+		// Читает байт по адресу из EAX через шину в ECX, адрес остаётся в EAX
+		void busRead() {
+			e.mov(RSI, RAX);
+			callHelper(helperBusRead);
+			e.mov(RCX, RAX);
+			e.aluImm(AND, RCX, 0xFF);
+			e.shr(RAX, 16);
+		}
+		
+		// Записывает младший байт src по адресу из EAX через шину, адрес остаётся в EAX
+		void busWrite(Reg src) {
+			e.mov(RSI, src);
+			e.shl(RSI, 16);
+			e.alu(OR, RSI, RAX);
+			callHelper(helperBusWrite);
+		}
+		
+		// Загружает значение операнда в ECX, адрес (если есть) остаётся в EAX.
+		// rmw - операнд инструкции чтения-модификации-записи
+		void operand(Addressing mode, uint16_t op, bool rmw = false) {
+			if (mode == Addressing::IMM) {
+				e.movImm(RCX, op);
+				return;
+			}
+			
+			address(mode, op, !rmw);
+			
+			const Bus::Page* const* pages = jit.bus.getReadPages();
+			const bool hooked = isConstant(mode) ? jit.bus.isReadHooked(op) : mayHook(pages, mode, op);
+			
+			if (!hooked) {
+				e.load8(RCX, Mem(REG_MEM, RAX, 0));
+				return;
+			}
+			
+			if (isConstant(mode)) {
+				busRead();
+				return;
+			}
+			
+			uint8_t* ram[2];
+			jumpIfRam(pages, ram);
+			
+			busRead();
+			uint8_t* done = e.jmpRel();
+			
+			e.bind(ram[0]);
+			e.bind(ram[1]);
+			e.load8(RCX, Mem(REG_MEM, RAX, 0));
+			e.bind(done);
+		}
+		
+		// Записывает младший байт src по адресу из EAX. index - номер инструкции в блоке
+		void store(Addressing mode, uint16_t op, Reg src, uint32_t index, uint32_t nextPc) {
+			const Bus::Page* const* pages = jit.bus.getWritePages();
+			const bool hooked = isConstant(mode) ? jit.bus.isWriteHooked(op) : mayHook(pages, mode, op);
+			
+			if (!hooked) {
+				e.store8(Mem(REG_MEM, RAX, 0), src);
+				
+			} else if (isConstant(mode)) {
+				busWrite(src);
+				
+			} else {
+				uint8_t* ram[2];
+				jumpIfRam(pages, ram);
+				
+				busWrite(src);
+				uint8_t* done = e.jmpRel();
+				
+				e.bind(ram[0]);
+				e.bind(ram[1]);
+				e.store8(Mem(REG_MEM, RAX, 0), src);
+				e.bind(done);
+			}
+			
+			// Блоки компилируются только из области кода кэша декодирования, поэтому запись ниже её начала
+			// (в том числе в нулевую страницу, если код загружен не в неё) блоки не затрагивает
+			const uint16_t codeStart = jit.cache.getStart();
+			const bool zp = mode == Addressing::ZP || mode == Addressing::ZP_X || mode == Addressing::ZP_Y;
+			
+			if (zp && codeStart >= 0x100) return;
+			if (mode == Addressing::ABS && op < codeStart) return;
+			
+			e.mov(RDX, RAX);
+			e.shr(RDX, 8);
+			e.movImm64(RSI, uint64_t(jit.cache.getDecodedPages()));
+			e.cmpMem8Imm(Mem(RSI, RDX, 0), 0);
+			uint8_t* skip = e.jccRel(CC_E);
+			
+			e.mov(RSI, RAX);
+			callHelper(helperWrite);
+			e.test(RAX, RAX);
+			exitTo(e.jccRel(CC_NE), nextPc, false, block.count - index - 1, cyclesAfter[index]);
+			
+			e.bind(skip);
+		}
+		
+		void setNZ(Reg reg) {
+			e.mov(REG_NZ, reg);
+		}
+		
+		void push(Reg reg) {
+			e.store8(Mem(REG_MEM, REG_SP, STACK_POS), reg);
+			e.aluImm(SUB, REG_SP, 1);
+			e.aluImm(AND, REG_SP, 0xFF);
+		}
+		
+		void pull(Reg reg) {
+			e.aluImm(ADD, REG_SP, 1);
+			e.aluImm(AND, REG_SP, 0xFF);
+			e.load8(reg, Mem(REG_MEM, REG_SP, STACK_POS));
+		}
+		
+		void compare(Reg reg) {
+			e.mov(RDX, reg);
+			e.alu(SUB, RDX, RCX);
+			e.aluImm(AND, RDX, 0xFF);
+			setNZ(RDX);
+			e.alu(CMP, reg, RCX);
+			e.movImm(REG_C, 0);
+			e.setcc(CC_AE, REG_C);
+		}
+		
+		// Операции сдвига над регистром reg (A или ECX)
+		void asl(Reg reg) {
+			e.mov(REG_C, reg);
+			e.shr(REG_C, 7);
+			e.shl(reg, 1);
+			e.aluImm(AND, reg, 0xFF);
+			setNZ(reg);
+		}
+		
+		void lsr(Reg reg) {
+			e.mov(REG_C, reg);
+			e.aluImm(AND, REG_C, 1);
+			e.shr(reg, 1);
+			setNZ(reg);
+		}
+		
+		void rol(Reg reg) {
+			e.shl(reg, 1);
+			e.alu(OR, reg, REG_C);
+			e.mov(REG_C, reg);
+			e.shr(REG_C, 8);
+			e.aluImm(AND, reg, 0xFF);
+			setNZ(reg);
+		}
+		
+		void ror(Reg reg) {
+			e.mov(RDX, REG_C);
+			e.shl(RDX, 8);
+			e.alu(OR, reg, RDX);
+			e.mov(REG_C, reg);
+			e.aluImm(AND, REG_C, 1);
+			e.shr(reg, 1);
+			setNZ(reg);
+		}
+		
+		void branch(Reg reg, uint32_t mask, Cond takenIf, uint16_t target, uint16_t next) {
+			e.testImm(reg, mask);
+			uint8_t* notTaken = e.jccRel(Cond(takenIf ^ 1));
+			
+			// Выполненный переход стоит один такт и ещё один при переходе на другую страницу
+			e.alu64MemImm(ADD, CTX(cycles), 1 + ((next ^ target) > 0xFF));
+			directExit(target);
+			
+			e.bind(notTaken);
+			directExit(next);
+		}
+		
+		
+		// Транслирует одну инструкцию. Возвращает false, если блок закончился
+		bool insn(const DecodedInsn& d, uint16_t pc, uint32_t index) {
+			const Addressing mode = getOpcodeInfo(d.opcode).mode;
+			const uint16_t op = d.operand;
+			const uint16_t next = uint16_t(pc + d.size);
+			
+			#define RMW(fn) operand(mode, op, true); fn(RCX); store(mode, op, RCX, index, next);
+			
+			switch (d.opcode) {
+				case LDA_IMM: case LDA_ZP: case LDA_ZP_X: case LDA_ABS: case LDA_ABS_X: case LDA_ABS_Y: case LDA_IND_X: case LDA_IND_Y:
+					operand(mode, op); e.mov(REG_A, RCX); setNZ(REG_A);
+					break;
+				
+				case LDX_IMM: case LDX_ZP: case LDX_ZP_Y: case LDX_ABS: case LDX_ABS_Y:
+					operand(mode, op); e.mov(REG_X, RCX); setNZ(REG_X);
+					break;
+				
+				case LDY_IMM: case LDY_ZP: case LDY_ZP_X: case LDY_ABS: case LDY_ABS_X:
+					operand(mode, op); e.mov(REG_Y, RCX); setNZ(REG_Y);
+					break;
+				
+				case STA_ZP: case STA_ZP_X: case STA_ABS: case STA_ABS_X: case STA_ABS_Y: case STA_IND_X: case STA_IND_Y:
+					address(mode, op); store(mode, op, REG_A, index, next);
+					break;
+				
+				case STX_ZP: case STX_ZP_Y: case STX_ABS:
+					address(mode, op); store(mode, op, REG_X, index, next);
+					break;
+				
+				case STY_ZP: case STY_ZP_X: case STY_ABS:
+					address(mode, op); store(mode, op, REG_Y, index, next);
+					break;
+				
+				case CMP_IMM: case CMP_ZP: case CMP_ZP_X: case CMP_ABS: case CMP_ABS_X: case CMP_ABS_Y: case CMP_IND_X: case CMP_IND_Y:
+					operand(mode, op); compare(REG_A);
+					break;
+				
+				case CPX_IMM: case CPX_ZP: case CPX_ABS:
+					operand(mode, op); compare(REG_X);
+					break;
+				
+				case CPY_IMM: case CPY_ZP: case CPY_ABS:
+					operand(mode, op); compare(REG_Y);
+					break;
+				
+				case BIT_ZP: case BIT_ABS:
+					operand(mode, op);
+					e.mov(RDX, REG_A);
+					e.alu(AND, RDX, RCX);
+					e.aluImm(CMP, RDX, 0);
+					e.movImm(RDX, 0);
+					e.setcc(CC_NE, RDX);
+					e.mov(REG_NZ, RCX);
+					e.aluImm(AND, REG_NZ, 0x80);
+					e.shl(REG_NZ, 8);
+					e.alu(OR, REG_NZ, RDX);
+					e.mov(REG_V, RCX);
+					e.shr(REG_V, 6);
+					e.aluImm(AND, REG_V, 1);
+					break;
+				
+				case AND_IMM: case AND_ZP: case AND_ZP_X: case AND_ABS: case AND_ABS_X: case AND_ABS_Y: case AND_IND_X: case AND_IND_Y:
+					operand(mode, op); e.alu(AND, REG_A, RCX); setNZ(REG_A);
+					break;
+				
+				case ORA_IMM: case ORA_ZP: case ORA_ZP_X: case ORA_ABS: case ORA_ABS_X: case ORA_ABS_Y: case ORA_IND_X: case ORA_IND_Y:
+					operand(mode, op); e.alu(OR, REG_A, RCX); setNZ(REG_A);
+					break;
+				
+				case EOR_IMM: case EOR_ZP: case EOR_ZP_X: case EOR_ABS: case EOR_ABS_X: case EOR_ABS_Y: case EOR_IND_X: case EOR_IND_Y:
+					operand(mode, op); e.alu(XOR, REG_A, RCX); setNZ(REG_A);
+					break;
+				
+				// V вычисляется так же, как в интерпретаторе
+				case ADC_IMM: case ADC_ZP: case ADC_ZP_X: case ADC_ABS: case ADC_ABS_X: case ADC_ABS_Y: case ADC_IND_X: case ADC_IND_Y:
+					operand(mode, op);
+					e.mov(RDX, REG_A);
+					e.alu(ADD, RDX, RCX);
+					e.alu(ADD, RDX, REG_C);
+					e.mov(REG_C, RDX);
+					e.shr(REG_C, 8);
+					e.alu(XOR, REG_V, REG_V);
+					e.mov(REG_A, RDX);
+					e.aluImm(AND, REG_A, 0xFF);
+					setNZ(REG_A);
+					break;
+				
+				case SBC_IMM: case SBC_ZP: case SBC_ZP_X: case SBC_ABS: case SBC_ABS_X: case SBC_ABS_Y: case SBC_IND_X: case SBC_IND_Y:
+					operand(mode, op);
+					e.mov(REG_V, REG_A);
+					e.alu(OR, REG_V, RCX);
+					e.alu(OR, REG_V, REG_C);
+					e.aluImm(CMP, REG_V, 0);
+					e.movImm(REG_V, 0);
+					e.setcc(CC_E, REG_V);
+					e.mov(RDX, REG_A);
+					e.alu(SUB, RDX, RCX);
+					e.alu(ADD, RDX, REG_C);
+					e.aluImm(SUB, RDX, 1);
+					e.mov(REG_C, RDX);
+					e.shr(REG_C, 31);
+					e.aluImm(XOR, REG_C, 1);
+					e.mov(REG_A, RDX);
+					e.aluImm(AND, REG_A, 0xFF);
+					setNZ(REG_A);
+					break;
+				
+				case ASL_A: asl(REG_A); break;
+				case LSR_A: lsr(REG_A); break;
+				case ROL_A: rol(REG_A); break;
+				case ROR_A: ror(REG_A); break;
+				
+				case ASL_ZP: case ASL_ZP_X: case ASL_ABS: case ASL_ABS_X: RMW(asl); break;
+				case LSR_ZP: case LSR_ZP_X: case LSR_ABS: case LSR_ABS_X: RMW(lsr); break;
+				case ROL_ZP: case ROL_ZP_X: case ROL_ABS: case ROL_ABS_X: RMW(rol); break;
+				case ROR_ZP: case ROR_ZP_X: case ROR_ABS: case ROR_ABS_X: RMW(ror); break;
+				
+				case INC_ZP: case INC_ZP_X: case INC_ABS: case INC_ABS_X:
+					operand(mode, op, true);
+					e.aluImm(ADD, RCX, 1);
+					e.aluImm(AND, RCX, 0xFF);
+					setNZ(RCX);
+					store(mode, op, RCX, index, next);
+					break;
+				
+				case DEC_ZP: case DEC_ZP_X: case DEC_ABS: case DEC_ABS_X:
+					operand(mode, op, true);
+					e.aluImm(SUB, RCX, 1);
+					e.aluImm(AND, RCX, 0xFF);
+					setNZ(RCX);
+					store(mode, op, RCX, index, next);
+					break;
+				
+				case INX: e.aluImm(ADD, REG_X, 1); e.aluImm(AND, REG_X, 0xFF); setNZ(REG_X); break;
+				case INY: e.aluImm(ADD, REG_Y, 1); e.aluImm(AND, REG_Y, 0xFF); setNZ(REG_Y); break;
+				case DEX: e.aluImm(SUB, REG_X, 1); e.aluImm(AND, REG_X, 0xFF); setNZ(REG_X); break;
+				case DEY: e.aluImm(SUB, REG_Y, 1); e.aluImm(AND, REG_Y, 0xFF); setNZ(REG_Y); break;
+				
+				case CLC: e.alu(XOR, REG_C, REG_C); break;
+				case SEC: e.movImm(REG_C, 1); break;
+				case CLV: e.alu(XOR, REG_V, REG_V); break;
+				case CLI: e.store8Imm(CTX(i), 0); break;
+				case SEI: e.store8Imm(CTX(i), 1); break;
+				case CLD: e.store8Imm(CTX(d), 0); break;
+				case SED: e.store8Imm(CTX(d), 1); break;
+				
+				case TAX: e.mov(REG_X, REG_A);  setNZ(REG_X); break;
+				case TXA: e.mov(REG_A, REG_X);  setNZ(REG_A); break;
+				case TAY: e.mov(REG_Y, REG_A);  setNZ(REG_Y); break;
+				case TYA: e.mov(REG_A, REG_Y);  setNZ(REG_A); break;
+				case TSX: e.mov(REG_X, REG_SP); setNZ(REG_X); break;
+				case TXS: e.mov(REG_SP, REG_X); break;
+				
+				case PHA: push(REG_A); break;
+				case PLA: pull(REG_A); setNZ(REG_A); break;
+				
+				case BEQ: branch(REG_NZ, 0xFF,   CC_E,  op, next); return false;
+				case BNE: branch(REG_NZ, 0xFF,   CC_NE, op, next); return false;
+				case BMI: branch(REG_NZ, 0x8080, CC_NE, op, next); return false;
+				case BPL: branch(REG_NZ, 0x8080, CC_E,  op, next); return false;
+				case BCS: branch(REG_C,  1,      CC_NE, op, next); return false;
+				case BCC: branch(REG_C,  1,      CC_E,  op, next); return false;
+				case BVS: branch(REG_V,  1,      CC_NE, op, next); return false;
+				case BVC: branch(REG_V,  1,      CC_E,  op, next); return false;
+				
+				case JMP_ABS:
+					directExit(op);
+					return false;
+				
+				case JMP_IND:
+					e.load8(RAX, Mem(REG_MEM, op));
+					e.load8(RDX, Mem(REG_MEM, op + 1));
+					e.shl(RDX, 8);
+					e.alu(OR, RAX, RDX);
+					indirectExit();
+					return false;
+				
+				case JSR:
+					e.movImm(RCX, uint16_t(pc + d.size - 1) >> 8);
+					push(RCX);
+					e.movImm(RCX, uint8_t(pc + d.size - 1));
+					push(RCX);
+					directExit(op);
+					return false;
+				
+				case RTS:
+					pull(RAX);
+					pull(RDX);
+					e.shl(RDX, 8);
+					e.alu(OR, RAX, RDX);
+					e.aluImm(ADD, RAX, 1);
+					e.aluImm(AND, RAX, 0xFFFF);
+					indirectExit();
+					return false;
+				
+				case BRK:
+					e.store8Imm(CTX(b), 1);
+					exitTo(e.jmpRel(), next, false);
+					return false;
+				
+				case RTI: e.store8Imm(CTX(b), 0); break;
+				case NOP: break;
+			}
+			
+			#undef RMW
+			
+			return true;
+		}
+	
+	public:
+		BlockCompiler(Jit::Impl& jit, Emitter& e, Block& block):
+				jit(jit), e(e), block(block) {}
+		
+		void compile(const std::vector<DecodedInsn>& insns) {
+			block.entry = e.cur();
+			
+			// Проверка бюджета инструкций на входе в блок
+			e.alu64MemImm(SUB, CTX(budget), int32_t(block.count));
+			exitTo(e.jccRel(CC_L), block.start, false, block.count);
+			
+			cyclesAfter.assign(insns.size(), 0);
+			uint32_t cycles = 0;
+			
+			for (size_t i = insns.size(); i-- > 0; ) {
+				cyclesAfter[i] = cycles;
+				cycles += insns[i].cycles;
+			}
+			
+			e.alu64MemImm(ADD, CTX(cycles), int32_t(cycles));
+			
+			uint16_t pc = block.start;
+			bool open = true;
+			
+			for (uint32_t i = 0; i < insns.size() && open; i++) {
+				open = insn(insns[i], pc, i);
+				pc = uint16_t(pc + insns[i].size);
+			}
+			
+			if (open) {
+				directExit(pc);
+			}
+			
+			// Код выходов располагается после тела блока
+			for (const PendingExit& exit : exits) {
+				uint8_t* stub = e.cur();
+				e.bind(exit.site);
+				
+				if (exit.refund != 0) {
+					e.alu64MemImm(ADD, CTX(budget), int32_t(exit.refund));
+				}
+				
+				if (exit.refundCycles != 0) {
+					e.alu64MemImm(SUB, CTX(cycles), int32_t(exit.refundCycles));
+				}
+				
+				e.movImm(RAX, exit.pc);
+				
+				if (exit.link != nullptr) {
+					exit.link->stub = stub;
+					e.movImm64(RDX, uint64_t(exit.link));
+				} else {
+					e.alu(XOR, RDX, RDX);
+				}
+				
+				e.jmpTo(jit.exitCommon);
+			}
+		}
+	};
+	
+	
+	// ------------------------------------------------------------------- Impl -------------------------------------------------------------------
+	
+	Jit::Impl::Impl(Bus& bus, DecodeCache& cache):
+			bus(bus), mem(bus.getMemory()), cache(cache), entries(0x10000), blocks(0x10000) {
+				
+		// Буфер создаётся доступным для записи, а после генерации общего кода - только для выполнения
+		void* buf = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		
+		if (buf != MAP_FAILED) {
+			code = static_cast<uint8_t*>(buf);
+			emitCommon();
+			
+			if (mprotect(code, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC) == 0) {
+				cache.setListener(this);
+				
+			} else {
+				// Система не разрешает выполнять сгенерированный код: всё выполняется интерпретатором
+				munmap(code, CODE_BUFFER_SIZE);
+				code = nullptr;
+			}
+		}
+		
+		std::fill(entries.begin(), entries.end(), exitIndirect);
+		
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.mem = mem;
+		ctx.impl = this;
+	}
+	
+	Jit::Impl::~Impl() {
+		if (code != nullptr) {
+			cache.setListener(nullptr);
+			munmap(code, CODE_BUFFER_SIZE);
+		}
+	}
+	
+	
+	// Генерирует код входа и выхода, общий для всех блоков
+	void Jit::Impl::emitCommon() {
+		Emitter e(code, CODE_BUFFER_SIZE);
+		
+		// void enter(JitContext* ctx, const void* target)
+		enter = reinterpret_cast<void (*)(JitContext*, const void*)>(e.cur());
+		
+		e.push(RBX);
+		e.push(RBP);
+		e.push(R12);
+		e.push(R13);
+		e.push(R14);
+		e.push(R15);
+		e.alu64Imm(SUB, RSP, 8); // Выравнивание стека на 16 байт
+		
+		e.mov64(REG_CTX, RDI);
+		e.load64(REG_MEM, CTX(mem));
+		e.load32(REG_A,  CTX(a));
+		e.load32(REG_X,  CTX(x));
+		e.load32(REG_Y,  CTX(y));
+		e.load32(REG_SP, CTX(sp));
+		e.load32(REG_NZ, CTX(nz));
+		e.load32(REG_C,  CTX(c));
+		e.load32(REG_V,  CTX(v));
+		e.jmp(RSI);
+		
+		// Выход с адресом перехода в EAX и без связывания
+		exitIndirect = e.cur();
+		e.alu(XOR, RDX, RDX);
+		
+		// Выход с адресом перехода в EAX и Link* в RDX
+		exitCommon = e.cur();
+		e.store32(CTX(pc), RAX);
+		e.store64(CTX(link), RDX);
+		e.store32(CTX(a),  REG_A);
+		e.store32(CTX(x),  REG_X);
+		e.store32(CTX(y),  REG_Y);
+		e.store32(CTX(sp), REG_SP);
+		e.store32(CTX(nz), REG_NZ);
+		e.store32(CTX(c),  REG_C);
+		e.store32(CTX(v),  REG_V);
+		e.alu64Imm(ADD, RSP, 8);
+		e.pop(R15);
+		e.pop(R14);
+		e.pop(R13);
+		e.pop(R12);
+		e.pop(RBP);
+		e.pop(RBX);
+		e.ret();
+		
+		codeStart = codeUsed = size_t(e.cur() - code);
+	}
+	
+	
+	void Jit::Impl::flush() {
+		for (auto& block : blocks) {
+			if (block != nullptr) {
+				dead.push_back(std::move(block));
+			}
+		}
+		
+		for (auto& page : pages) {
+			page.clear();
+		}
+		
+		std::fill(entries.begin(), entries.end(), exitIndirect);
+		codeUsed = codeStart;
+		flushes++;
+	}
+	
+	
+	void Jit::Impl::invalidate(Block* block) {
+		CodeWriter writer(*this);
+		entries[block->start] = exitIndirect;
+		
+		for (Link* link : block->incoming) {
+			Emitter::link(link->site, link->stub);
+			link->patched = nullptr;
+		}
+		
+		for (auto& link : block->links) {
+			if (link->patched != nullptr) {
+				auto& incoming = link->patched->incoming;
+				incoming.erase(std::remove(incoming.begin(), incoming.end(), link.get()), incoming.end());
+			}
+		}
+		
+		for (uint32_t page = block->start >> 8; page <= (block->end - 1) >> 8 && page < 0x100; page++) {
+			auto& list = pages[page];
+			list.erase(std::remove(list.begin(), list.end(), block), list.end());
+		}
+		
+		if (block->entry != nullptr) {
+			stats.invalidations++;
+		}
+		
+		// Блок может выполняться прямо сейчас, поэтому удаляется только после возврата в диспетчер
+		dead.push_back(std::move(blocks[block->start]));
+		ctx.invalidated = 1;
+	}
+	
+	
+	void Jit::Impl::onInvalidate(uint16_t addr) {
+		std::vector<Block*> affected;
+		
+		for (Block* block : pages[addr >> 8]) {
+			if (block->start <= addr && addr < block->end) {
+				affected.push_back(block);
+			}
+		}
+		
+		if (affected.empty()) {
+			return;
+		}
+		
+		CodeWriter writer(*this); // Один mprotect на все затронутые блоки
+		
+		for (Block* block : affected) {
+			invalidate(block);
+		}
+	}
+	
+	
+	void Jit::Impl::patch(Link* link, Block* target) {
+		CodeWriter writer(*this);
+		Emitter::link(link->site, target->entry);
+		link->patched = target;
+		target->incoming.push_back(link);
+	}
+	
+	
+	Block* Jit::Impl::getBlock(uint16_t pc) {
+		if (code == nullptr || pc < cache.getStart()) {
+			return nullptr;
+		}
+		
+		if (blocks[pc] == nullptr) {
+			auto start = std::chrono::steady_clock::now();
+			std::unique_ptr<Block> block;
+			
+			{
+				CodeWriter writer(*this);
+				block = compile(pc);
+				
+				if (block == nullptr) {
+					flush();
+					block = compile(pc);
+				}
+			}
+			
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			stats.compileSeconds += elapsed.count();
+			
+			if (block == nullptr) {
+				return nullptr;
+			}
+			
+			for (uint32_t page = block->start >> 8; page <= (block->end - 1) >> 8 && page < 0x100; page++) {
+				pages[page].push_back(block.get());
+			}
+			
+			if (block->entry != nullptr) {
+				entries[pc] = block->entry;
+				stats.blocks++;
+			}
+			
+			blocks[pc] = std::move(block);
+		}
+		
+		return blocks[pc].get();
+	}
+	
+	
+	// Возвращает NULL, если не хватило места в буфере кода
+	std::unique_ptr<Block> Jit::Impl::compile(uint16_t pc) {
+		std::unique_ptr<Block> block(new Block());
+		block->start = pc;
+		block->entry = nullptr;
+		
+		std::vector<DecodedInsn> insns;
+		uint32_t addr = pc;
+		
+		while (insns.size() < MAX_BLOCK_INSNS && addr < MEM_SIZE) {
+			DecodedInsn insn = cache.fetch(mem, uint16_t(addr));
+			
+			if (!isSupportedOpcode(insn.opcode) || addr + insn.size > MEM_SIZE) {
+				break;
+			}
+			
+			insns.push_back(insn);
+			addr += insn.size;
+			
+			if (isBlockEnd(insn.opcode)) {
+				break;
+			}
+		}
+		
+		block->count = uint32_t(insns.size());
+		
+		if (insns.empty()) {
+			// Блок-заглушка: отмечает адрес, который всегда выполняется интерпретатором
+			block->end = std::min(uint32_t(pc) + std::max<uint32_t>(cache.fetch(mem, pc).size, 1), uint32_t(MEM_SIZE));
+			return block;
+		}
+		
+		block->end = addr;
+		
+		Emitter e(code + codeUsed, CODE_BUFFER_SIZE - codeUsed);
+		BlockCompiler(*this, e, *block).compile(insns);
+		
+		if (e.failed()) {
+			return nullptr;
+		}
+		
+		codeUsed += size_t(e.cur() - (code + codeUsed));
+		return block;
+	}
+	
+	
+	void Jit::Impl::loadContext(const processor_state& state) {
+		bool n = FLAG_N(state.flags), z = FLAG_Z(state.flags);
+		
+		ctx.a  = state.a;
+		ctx.x  = state.x;
+		ctx.y  = state.y;
+		ctx.sp = state.sp;
+		ctx.pc = state.pc;
+		ctx.cycles = state.cycles;
+		ctx.nz = z ? (n ? 0x8000 : 0) : (n ? 0x80 : 1);
+		ctx.c  = FLAG_C(state.flags);
+		ctx.v  = FLAG_V(state.flags);
+		ctx.b  = FLAG_B(state.flags);
+		ctx.d  = FLAG_D(state.flags);
+		ctx.i  = FLAG_I(state.flags);
+	}
+	
+	void Jit::Impl::storeContext(processor_state* state) const {
+		bool n = (ctx.nz & 0x8080) != 0, z = (ctx.nz & 0xFF) == 0;
+		
+		state->a  = uint8_t(ctx.a);
+		state->x  = uint8_t(ctx.x);
+		state->y  = uint8_t(ctx.y);
+		state->sp = uint8_t(ctx.sp);
+		state->pc = uint16_t(ctx.pc);
+		state->cycles = ctx.cycles;
+		state->flags = uint8_t(n << 7 | ctx.v << 6 | 1 << 5 | ctx.b << 4 | ctx.d << 3 | ctx.i << 2 | z << 1 | ctx.c);
+	}
+	
+	
+	int Jit::Impl::run(processor_state* state, uint64_t limit) {
+		loadContext(*state);
+		
+		uint64_t remaining = limit;
+		
+		while (!ctx.b && remaining != 0) {
+			dead.clear();
+			
+			Block* block = getBlock(uint16_t(ctx.pc));
+			
+			if (block == nullptr || block->entry == nullptr || block->count > remaining) {
+				storeContext(state);
+				
+				int res = int6502::run(bus, cache, state, 1);
+				if (res != EXIT_SUCCESS) return res;
+				
+				loadContext(*state);
+				remaining -= 1;
+				stats.fallbackInsns += 1;
+				continue;
+			}
+			
+			int64_t budget = remaining > uint64_t(INT64_MAX) ? INT64_MAX : int64_t(remaining);
+			ctx.budget = budget;
+			ctx.link = nullptr;
+			
+			enter(&ctx, block->entry);
+			
+			uint64_t executed = uint64_t(budget - ctx.budget);
+			remaining -= executed;
+			state->insns += executed;
+			stats.nativeInsns += executed;
+			
+			// Связывание блока, из которого произошёл выход, с целевым блоком
+			if (ctx.link != nullptr) {
+				Link* link = static_cast<Link*>(ctx.link);
+				uint64_t flushesBefore = flushes;
+				Block* target = getBlock(link->target);
+				
+				if (flushes == flushesBefore && target != nullptr && target->entry != nullptr) {
+					patch(link, target);
+				}
+			}
+		}
+		
+		storeContext(state);
+		return EXIT_SUCCESS;
+	}
+	
+	
+	// ------------------------------------------------------------------- Jit --------------------------------------------------------------------
+	
+	Jit::Jit(Bus& bus, DecodeCache& cache):
+			impl(new Impl(bus, cache)) {}
+	
+	Jit::~Jit() {}
+	
+	bool Jit::isSupported() {
+		return true;
+	}
+	
+	int Jit::run(processor_state* state, uint64_t limit) {
+		return impl->run(state, limit);
+	}
+	
+	const JitStats& Jit::getStats() const {
+		return impl->stats;
+	}
+
+#else
+	
+	// Без поддержки JIT весь код выполняется интерпретатором
+	
+	struct Jit::Impl {
+		Bus& bus;
+		DecodeCache& cache;
+		JitStats stats;
+		
+		Impl(Bus& bus, DecodeCache& cache):
+				bus(bus), cache(cache) {}
+	};
+	
+	Jit::Jit(Bus& bus, DecodeCache& cache):
+			impl(new Impl(bus, cache)) {}
+	
+	Jit::~Jit() {}
+	
+	bool Jit::isSupported() {
+		return false;
+	}
+	
+	int Jit::run(processor_state* state, uint64_t limit) {
+		uint64_t before = state->insns;
+		int res = int6502::run(impl->bus, impl->cache, state, limit);
+		impl->stats.fallbackInsns += state->insns - before;
+		return res;
+	}
+	
+	const JitStats& Jit::getStats() const {
+		return impl->stats;
+	}
+
+#endif
+}
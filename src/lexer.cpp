@@ -0,0 +1,161 @@
+#include "lexer.h"
+#include "error_codes.h"
+#include "util.h"
+#include <cctype>
+#include <cstdlib>
+
+namespace int6502 {
+	
+	static inline bool isWordChar(char c) {
+		return std::isalnum(uint8_t(c)) || c == '_' || c == '$';
+	}
+	
+	
+	Token Lexer::next() {
+		while (pos < str.size() && std::isspace(uint8_t(str[pos]))) {
+			pos++;
+		}
+		
+		const size_t start = pos;
+		
+		if (pos == str.size()) {
+			return Token { TokenKind::END, start, 0 };
+		}
+		
+		if (isWordChar(str[pos])) {
+			do {
+				pos++;
+			} while (pos < str.size() && isWordChar(str[pos]));
+			
+			return Token { TokenKind::WORD, start, pos - start };
+		}
+		
+		TokenKind kind;
+		
+		switch (str[pos]) {
+			case '#': kind = TokenKind::HASH;   break;
+			case '(': kind = TokenKind::LPAREN; break;
+			case ')': kind = TokenKind::RPAREN; break;
+			case ',': kind = TokenKind::COMMA;  break;
+			default:  kind = TokenKind::INVALID;
+		}
+		
+		pos++;
+		return Token { kind, start, 1 };
+	}
+	
+	bool Lexer::isRegister(const Token& token, char c) const {
+		return token.kind == TokenKind::WORD && token.length == 1 && std::tolower(uint8_t(str[token.pos])) == c;
+	}
+	
+	
+	// Сообщение об ошибке с описанием найденной вместо ожидаемой лексемы
+	static int unexpectedToken(const Lexer& lexer, const Token& token, int lineNum, int column, const char* expected) {
+		const int tokenColumn = column + int(token.pos);
+		
+		if (token.kind == TokenKind::END) {
+			return syntaxErrorAt(lineNum, tokenColumn, "Expected %s", expected);
+		}
+		
+		return syntaxErrorAt(lineNum, tokenColumn, "Expected %s, got \"%s\"", expected, lexer.text(token).c_str());
+	}
+	
+	
+	// Грамматика:
+	//   operand := '#' WORD (без пробела после '#') | WORD [',' ('x' | 'y')] | '(' WORD [',' 'x'] ')' [',' 'y']
+	int parseOperand(const std::string& str, int lineNum, int column, Operand& operand) {
+		Lexer lexer(str);
+		Token token = lexer.next();
+		
+		bool immediate = false, indirect = false;
+		
+		if (token.kind == TokenKind::HASH) {
+			const size_t hashEnd = token.pos + token.length;
+			
+			immediate = true;
+			token = lexer.next();
+			
+			// Значение записывается сразу после '#', без пробелов
+			if (token.kind == TokenKind::WORD && token.pos != hashEnd) {
+				return syntaxErrorAt(lineNum, column + int(hashEnd), "Expected number or name right after \"#\"");
+			}
+			
+		} else if (token.kind == TokenKind::LPAREN) {
+			indirect = true;
+			token = lexer.next();
+		}
+		
+		if (token.kind != TokenKind::WORD) {
+			return unexpectedToken(lexer, token, lineNum, column, "number or name");
+		}
+		
+		operand.value = token;
+		operand.column = column + int(token.pos);
+		
+		token = lexer.next();
+		
+		if (immediate) {
+			operand.kind = OperandKind::IMMEDIATE;
+			
+		} else if (indirect) {
+			if (token.kind == TokenKind::COMMA) {
+				token = lexer.next();
+				
+				if (!lexer.isRegister(token, 'x')) {
+					return unexpectedToken(lexer, token, lineNum, column, "\"x\"");
+				}
+				
+				token = lexer.next();
+				
+				if (token.kind != TokenKind::RPAREN) {
+					return unexpectedToken(lexer, token, lineNum, column, "\")\"");
+				}
+				
+				operand.kind = OperandKind::INDIRECT_X;
+				token = lexer.next();
+				
+			} else if (token.kind == TokenKind::RPAREN) {
+				operand.kind = OperandKind::INDIRECT;
+				token = lexer.next();
+				
+				if (token.kind == TokenKind::COMMA) {
+					token = lexer.next();
+					
+					if (!lexer.isRegister(token, 'y')) {
+						return unexpectedToken(lexer, token, lineNum, column, "\"y\"");
+					}
+					
+					operand.kind = OperandKind::INDIRECT_Y;
+					token = lexer.next();
+				}
+				
+			} else {
+				return unexpectedToken(lexer, token, lineNum, column, "\",\" or \")\"");
+			}
+			
+		} else if (token.kind == TokenKind::COMMA) {
+			token = lexer.next();
+			
+			if (lexer.isRegister(token, 'x')) {
+				operand.kind = OperandKind::INDEXED_X;
+				
+			} else if (lexer.isRegister(token, 'y')) {
+				operand.kind = OperandKind::INDEXED_Y;
+				
+			} else {
+				return unexpectedToken(lexer, token, lineNum, column, "\"x\" or \"y\"");
+			}
+			
+			token = lexer.next();
+			
+		} else {
+			operand.kind = OperandKind::DIRECT;
+		}
+		
+		if (token.kind != TokenKind::END) {
+			return unexpectedToken(lexer, token, lineNum, column, "end of line");
+		}
+		
+		return EXIT_SUCCESS;
+	}
+}
@@ -0,0 +1,237 @@
+#include "loader.h"
+#include "translator.h"
+#include "mapped_file.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace int6502 {
+	
+	using std::vector;
+	
+	
+	bool parseImageFormat(const char* name, ImageFormat& format) {
+		#define PARSE_IMAGE_FORMAT(formatName, option) \
+			if (strcmp(name, option) == 0) { format = ImageFormat::formatName; return true; }
+		
+		INT6502_IMAGE_FORMATS(PARSE_IMAGE_FORMAT)
+		
+		#undef PARSE_IMAGE_FORMAT
+		
+		return false;
+	}
+	
+	
+	ImageFormat detectImageFormat(const char* filename) {
+		const char* const dot = strrchr(filename, '.');
+		
+		if (dot == nullptr || strchr(dot, '/') != nullptr) {
+			return ImageFormat::SOURCE;
+		}
+		
+		const char* const ext = dot + 1;
+		
+		if (strcasecmp(ext, "prg") == 0) {
+			return ImageFormat::PRG;
+		}
+		
+		if (strcasecmp(ext, "hex") == 0 || strcasecmp(ext, "ihx") == 0 || strcasecmp(ext, "ihex") == 0) {
+			return ImageFormat::HEX;
+		}
+		
+		if (strcasecmp(ext, "bin") == 0 || strcasecmp(ext, "raw") == 0) {
+			return ImageFormat::RAW;
+		}
+		
+		return ImageFormat::SOURCE;
+	}
+	
+	
+	static int tooLargeError(const char* filename, size_t size, uint16_t addr) {
+		return error(INVALID_SYNTAX_ERROR, "\"%s\": %zu bytes do not fit in memory at $%04X", filename, size, addr);
+	}
+	
+	
+	static int loadRaw(const char* filename, const uint8_t* data, size_t size, Image& image) {
+		if (size > MEM_SIZE - image.addr) {
+			return tooLargeError(filename, size, image.addr);
+		}
+		
+		image.code.assign(data, data + size);
+		image.entry = image.addr;
+		return EXIT_SUCCESS;
+	}
+	
+	
+	static int loadPrg(const char* filename, const uint8_t* data, size_t size, Image& image) {
+		if (size < 2) {
+			return error(INVALID_SYNTAX_ERROR, "\"%s\" is not a PRG file: no load address", filename);
+		}
+		
+		image.addr = uint16_t(data[0] | data[1] << 8);
+		return loadRaw(filename, data + 2, size - 2, image);
+	}
+	
+	
+	static int hexDigit(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+	
+	
+	// Запись Intel HEX: ':' LL AAAA TT DD... CC, где LL - длина данных, AAAA - адрес,
+	// TT - тип записи, CC - контрольная сумма (сумма всех байтов записи равна 0 по модулю 256).
+	// Поддерживаются типы 00 (данные), 01 (конец файла), 02 и 04 (расширенный адрес, должен быть нулевым)
+	// и 03 и 05 (адрес начала выполнения)
+	static int loadHex(const char* filename, const char* text, size_t size, Image& image) {
+		enum RecordType { DATA = 0, END_OF_FILE = 1, SEGMENT = 2, START_SEGMENT = 3, LINEAR = 4, START_LINEAR = 5 };
+		
+		vector<uint8_t> mem(MEM_SIZE, 0);
+		size_t minAddr = MEM_SIZE, maxAddr = 0;
+		
+		bool hasEntry = false;
+		uint32_t entry = 0;
+		
+		const char* const end = text + size;
+		int lineNum = 1;
+		bool finished = false;
+		
+		for (const char* line = text; line < end && !finished; ++lineNum) {
+			const char* newline = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+			
+			if (newline == nullptr) {
+				newline = end;
+			}
+			
+			const char* lineEnd = newline;
+			while (lineEnd > line && std::isspace(uint8_t(lineEnd[-1]))) lineEnd--;
+			
+			const char* pos = line;
+			while (pos < lineEnd && std::isspace(uint8_t(*pos))) pos++;
+			
+			line = newline + 1;
+			
+			if (pos == lineEnd) continue;
+			
+			if (*pos != ':' || (lineEnd - pos) % 2 != 1 || lineEnd - pos < 11) {
+				return syntaxError(lineNum, "Invalid Intel HEX record in \"%s\"", filename);
+			}
+			
+			uint8_t record[0x100 + 5];
+			size_t length = 0;
+			
+			for (const char* s = pos + 1; s < lineEnd; s += 2) {
+				const int high = hexDigit(s[0]), low = hexDigit(s[1]);
+				
+				if (high < 0 || low < 0 || length == sizeof(record)) {
+					return syntaxError(lineNum, "Invalid Intel HEX record in \"%s\"", filename);
+				}
+				
+				record[length++] = uint8_t(high << 4 | low);
+			}
+			
+			const size_t dataSize = record[0];
+			
+			if (length != dataSize + 5) {
+				return syntaxError(lineNum, "Intel HEX record length does not match its data in \"%s\"", filename);
+			}
+			
+			uint8_t sum = 0;
+			
+			for (size_t i = 0; i < length; i++) {
+				sum = uint8_t(sum + record[i]);
+			}
+			
+			if (sum != 0) {
+				return syntaxError(lineNum, "Intel HEX checksum mismatch in \"%s\"", filename);
+			}
+			
+			const uint16_t addr = uint16_t(record[1] << 8 | record[2]);
+			const uint8_t* const data = record + 4;
+			
+			switch (record[3]) {
+				case DATA:
+					if (addr + dataSize > MEM_SIZE) {
+						return syntaxError(lineNum, "Intel HEX record does not fit in memory in \"%s\"", filename);
+					}
+					
+					if (dataSize != 0) {
+						memcpy(mem.data() + addr, data, dataSize);
+						minAddr = std::min(minAddr, size_t(addr));
+						maxAddr = std::max(maxAddr, addr + dataSize);
+					}
+					
+					break;
+				
+				case END_OF_FILE:
+					finished = true;
+					break;
+				
+				// 6502 адресует только 64 КиБ, поэтому расширенный адрес может быть только нулевым
+				case SEGMENT:
+				case LINEAR:
+					if (dataSize != 2 || data[0] != 0 || data[1] != 0) {
+						return syntaxError(lineNum, "Intel HEX extended address is out of 64 KiB in \"%s\"", filename);
+					}
+					
+					break;
+				
+				case START_SEGMENT:
+				case START_LINEAR:
+					if (dataSize != 4) {
+						return syntaxError(lineNum, "Invalid Intel HEX start address in \"%s\"", filename);
+					}
+					
+					// CS:IP для типа 03 и 32-битный адрес для типа 05
+					entry = record[3] == START_SEGMENT ?
+							uint32_t(data[0] << 8 | data[1]) * 16 + uint32_t(data[2] << 8 | data[3]) :
+							uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | data[3];
+					
+					if (entry >= MEM_SIZE) {
+						return syntaxError(lineNum, "Intel HEX start address is out of 64 KiB in \"%s\"", filename);
+					}
+					
+					hasEntry = true;
+					break;
+				
+				default:
+					return syntaxError(lineNum, "Unknown Intel HEX record type %02X in \"%s\"", record[3], filename);
+			}
+		}
+		
+		if (minAddr == MEM_SIZE) {
+			return error(INVALID_SYNTAX_ERROR, "\"%s\" contains no data", filename);
+		}
+		
+		image.code.assign(mem.begin() + minAddr, mem.begin() + maxAddr);
+		image.addr = uint16_t(minAddr);
+		image.entry = hasEntry ? uint16_t(entry) : image.addr;
+		return EXIT_SUCCESS;
+	}
+	
+	
+	int loadImage(const char* filename, ImageFormat format, Image& image) {
+		if (format == ImageFormat::SOURCE) {
+			image.addr = image.entry = CODE_POS;
+			return translate(filename, image.code);
+		}
+		
+		MappedFile file;
+		
+		int res = file.open(filename);
+		if (res != EXIT_SUCCESS) return res;
+		
+		switch (format) {
+			case ImageFormat::RAW: return loadRaw(filename, file.getData(), file.getSize(), image);
+			case ImageFormat::PRG: return loadPrg(filename, file.getData(), file.getSize(), image);
+			case ImageFormat::HEX: return loadHex(filename, file.getChars(), file.getSize(), image);
+			default: return INTERNAL_ERROR;
+		}
+	}
+}
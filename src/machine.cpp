@@ -0,0 +1,206 @@
+#include "machine.h"
+#include "translator.h"
+#include "decoder.h"
+#include "insn.h"
+#include "fusion.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <cstring>
+
+namespace int6502 {
+	
+	// Профилировщику и трассе нужна каждая инструкция по отдельности
+	static bool isInstrumented(const MachineOptions& options) {
+		return options.profiler != nullptr || options.tracer != nullptr;
+	}
+	
+	
+	Machine::Machine(const MachineOptions& options):
+			mem(new uint8_t[MEM_SIZE]()), state(initialState()), bus(mem.get()), random(state.random), options(options) {
+				
+		bus.map(&random, RND_POS, RND_POS, Bus::READ);
+	}
+	
+	Machine::~Machine() {}
+	
+	
+	int Machine::assemble(const char* filename) {
+		std::vector<uint8_t> code;
+		
+		int res = translate(filename, code);
+		if (res != EXIT_SUCCESS) return res;
+		
+		return load(code);
+	}
+	
+	int Machine::assemble(std::istream& source) {
+		std::vector<uint8_t> code;
+		
+		int res = translate(source, code);
+		if (res != EXIT_SUCCESS) return res;
+		
+		return load(code);
+	}
+	
+	
+	int Machine::load(const std::vector<uint8_t>& code, uint16_t addr, uint16_t entry) {
+		if (code.size() > MEM_SIZE - addr) {
+			return error(INTERNAL_ERROR, "Code is too large: %zu bytes", code.size());
+		}
+		
+		memset(mem.get(), 0, MEM_SIZE);
+		memcpy(mem.get() + addr, code.data(), code.size());
+		
+		state = initialState();
+		state.pc = entry;
+		
+		// Код, загруженный ниже CODE_POS, тоже кэшируется и компилируется
+		codeStart = std::min(addr, CODE_POS);
+		state.random.seed(options.seed, options.random);
+		
+		// Кэш и JIT создаются заново, так как ссылаются на старый код
+		jit.reset();
+		cache.reset(new DecodeCache(options.fusion && !isInstrumented(options), codeStart));
+		
+		display.mark();
+		return EXIT_SUCCESS;
+	}
+	
+	
+	int Machine::step(uint64_t count) {
+		if (cache == nullptr) {
+			return error(INTERNAL_ERROR, "No program loaded");
+		}
+		
+		if (options.jit && !isInstrumented(options) && jit == nullptr && Jit::isSupported()) {
+			jit.reset(new Jit(bus, *cache));
+		}
+		
+		int res = jit != nullptr ?
+				jit->run(&state, count) :
+				int6502::run(bus, *cache, &state, count, options.profiler, options.tracer);
+		
+		flushFrame();
+		return res;
+	}
+	
+	void Machine::flushFrame() {
+		if (frameHandler && display.take()) {
+			frameHandler(mem.get() + GPU_POS);
+		}
+	}
+	
+	
+	// Максимальное количество тактов на одну инструкцию (BRK, а также ASL/LSR/ROL/ROR/INC/DEC abs,x)
+	static const uint64_t MAX_INSN_CYCLES = 7;
+	
+	// Количество инструкций, которое runUntil выполняет за один шаг так, чтобы не превысить cycles тактов
+	static uint64_t insnsForCycles(uint64_t cycles) {
+		return std::max<uint64_t>(1, cycles / MAX_INSN_CYCLES);
+	}
+	
+	int Machine::runUntil(uint64_t cycles) {
+		while (state.cycles < cycles && !isStopped()) {
+			int res = step(insnsForCycles(cycles - state.cycles));
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	int Machine::run() {
+		while (!isStopped()) {
+			int res = step(UINT64_MAX);
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	
+	Snapshot Machine::snapshot(const Snapshot* base) const {
+		return Snapshot(mem.get(), state, base);
+	}
+	
+	int Machine::restore(const Snapshot& snapshot) {
+		if (cache == nullptr) {
+			cache.reset(new DecodeCache(options.fusion && !isInstrumented(options), codeStart));
+		}
+		
+		const bool* decodedPages = cache->getDecodedPages();
+		
+		for (size_t i = 0; i < Snapshot::PAGES; i++) {
+			uint8_t* page = mem.get() + i * Snapshot::PAGE_SIZE;
+			const Snapshot::Page& data = snapshot.getPage(i);
+			
+			if (memcmp(page, data.data(), Snapshot::PAGE_SIZE) == 0) {
+				continue;
+			}
+			
+			memcpy(page, data.data(), Snapshot::PAGE_SIZE);
+			
+			// Страница отмечена и тогда, когда в ней заканчивается инструкция с предыдущей страницы
+			if (decodedPages[i]) {
+				for (size_t addr = i * Snapshot::PAGE_SIZE; addr < (i + 1) * Snapshot::PAGE_SIZE; addr++) {
+					cache->invalidate(uint16_t(addr));
+				}
+			}
+		}
+		
+		state = snapshot.getState();
+		state.flags &= ~0x10;
+		
+		display.mark();
+		flushFrame();
+		return EXIT_SUCCESS;
+	}
+	
+	void Machine::reseed(uint64_t seed) {
+		state.random.seed(seed, options.random);
+	}
+	
+	
+	bool Machine::isStopped() const {
+		return FLAG_B(state.flags);
+	}
+	
+	void Machine::setInput(uint8_t key) {
+		mem[INPUT_POS] = key;
+	}
+	
+	void Machine::setFrameHandler(FrameHandler handler) {
+		frameHandler = std::move(handler);
+		
+		// Изменения видеопамяти отслеживаются, только если их есть кому показать
+		bus.unmap(&display);
+		
+		if (frameHandler) {
+			bus.map(&display, GPU_POS, GPU_POS + GPU_SIZE - 1, Bus::WRITE);
+		}
+		
+		display.mark();
+		jit.reset();
+	}
+	
+	
+	int Machine::mapDevice(Bus::Device* device, uint16_t first, uint16_t last, unsigned access) {
+		jit.reset();
+		return bus.map(device, first, last, access);
+	}
+	
+	void Machine::unmapDevice(Bus::Device* device) {
+		jit.reset();
+		bus.unmap(device);
+	}
+	
+	
+	const JitStats* Machine::getJitStats() const {
+		return jit != nullptr ? &jit->getStats() : nullptr;
+	}
+	
+	const uint64_t* Machine::getFusionHits() const {
+		static const uint64_t NO_HITS[FUSION_COUNT] = {};
+		return cache != nullptr ? cache->getFusionHits() : NO_HITS;
+	}
+}
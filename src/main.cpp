@@ -1,20 +1,365 @@
 #include "translator.h"
+#include "cache.h"
+#include "loader.h"
 #include "executor.h"
+#include "profiler.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "input_log.h"
 #include "drawer.h"
 #include "error_codes.h"
 #include "util.h"
 #include <csignal>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <ncurses.h>
 
 namespace int6502 {
-	int run(const char* filename) {
-		std::vector<uint8_t> code;
+	struct Options {
+		const char* filename = nullptr;
+		bool formatSet = false;
+		ImageFormat format = ImageFormat::SOURCE;  // Без --format определяется по расширению файла
+		bool loadAddressSet = false;
+		uint16_t loadAddress = CODE_POS;           // Адрес загрузки двоичного образа (только для raw)
+		bool entrySet = false;
+		uint16_t entry = CODE_POS;                 // Адрес начала выполнения вместо адреса из файла
+		const char* output = nullptr; // NULL - stdout
+		bool headless = false;
+		bool stats = false;
+		bool jit = false;
+		bool fusion = true;
+		CacheMode cache = CacheMode::USE; // Кеш результата трансляции рядом с исходником
+		uint64_t clock = 0;
+		unsigned maxFps = 60;
+		bool seeded = false;
+		uint64_t seed = 0;
+		RandomKind random = RandomKind::XORSHIFT;
+		const char* profile = nullptr;    // Куда записать отчёт профилировщика
+		const char* flamegraph = nullptr; // Куда записать стеки вызовов для flamegraph
+		const char* trace = nullptr;      // Куда записать трассу выполнения
+		size_t traceSize = Tracer::DEFAULT_CAPACITY; // Сколько последних инструкций хранится в трассе
+		const char* loadState = nullptr;  // Снимок, с которого начинается выполнение
+		const char* saveState = nullptr;  // Куда записать снимок после остановки
+		uint64_t rewindInterval = 0;      // Тактов между снимками для перемотки, 0 - без перемотки
+		size_t rewindDepth = 1000;
+		const char* record = nullptr;     // Куда записывать нажатые клавиши
+		const char* replay = nullptr;     // Запись клавиш для воспроизведения
+	};
+	
+	
+	// Записывает результаты профилирования в файлы, указанные в options
+	static int writeProfile(const Options& options, const Profiler& profiler, const DebugInfo& debug) {
+		if (options.profile != nullptr) {
+			FILE* file = fopen(options.profile, "w");
+			if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.profile);
+			
+			profiler.writeReport(file, &debug);
+			fclose(file);
+		}
+		
+		if (options.flamegraph != nullptr) {
+			FILE* file = fopen(options.flamegraph, "w");
+			if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.flamegraph);
+			
+			profiler.writeFolded(file, &debug);
+			fclose(file);
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	// Записывает профиль, трассу и снимок, если они собирались. res - результат выполнения программы:
+	// при ошибке выполнения трасса и снимок всё равно записываются, а возвращается исходная ошибка
+	static int writeResults(int res, const Options& options, const Profiler* profiler, const Tracer* tracer,
+			const Snapshot& saved, const DebugInfo& debug) {
+				
+		if (profiler != nullptr) {
+			int profileRes = writeProfile(options, *profiler, debug);
+			if (res == EXIT_SUCCESS) res = profileRes;
+		}
+		
+		if (tracer != nullptr) {
+			int traceRes = tracer->write(options.trace);
+			if (res == EXIT_SUCCESS) res = traceRes;
+		}
+		
+		if (options.saveState != nullptr) {
+			int saveRes = saved.save(options.saveState);
+			if (res == EXIT_SUCCESS) res = saveRes;
+		}
+		
+		return res;
+	}
+	
+	
+	int run(const Options& options) {
+		Image image;
+		image.addr = options.loadAddress;
+		DebugInfo debug;
+		
+		int res = EXIT_SUCCESS;
+		
+		// Со снимком исходник нужен только для лейблов в отчётах. Двоичные образы лейблов не содержат
+		if (options.filename != nullptr) {
+			res = options.format == ImageFormat::SOURCE ?
+					translateCached(options.filename, image.code, debug, options.cache) :
+					loadImage(options.filename, options.format, image);
+			
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		if (options.entrySet) {
+			image.entry = options.entry;
+		}
+		
+		Snapshot initial, saved;
+		
+		if (options.loadState != nullptr) {
+			res = initial.load(options.loadState);
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		std::unique_ptr<Profiler> profiler;
+		
+		if (options.profile != nullptr || options.flamegraph != nullptr) {
+			profiler.reset(new Profiler);
+		}
+		
+		std::unique_ptr<Tracer> tracer;
+		
+		if (options.trace != nullptr) {
+			tracer.reset(new Tracer(options.traceSize));
+		}
+		
+		InputRecorder recorder;
+		InputLog replay;
+		
+		if (options.record != nullptr) {
+			res = recorder.open(options.record);
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		if (options.replay != nullptr) {
+			res = replay.load(options.replay);
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		ExecuteOptions executeOptions;
+		executeOptions.jit = options.jit;
+		executeOptions.fusion = options.fusion;
+		executeOptions.loadAddress = image.addr;
+		executeOptions.entry = image.entry;
+		executeOptions.clock = options.clock;
+		executeOptions.maxFps = options.maxFps;
+		executeOptions.seeded = options.seeded;
+		executeOptions.seed = options.seed;
+		executeOptions.random = options.random;
+		executeOptions.stats = options.stats ? stderr : nullptr;
+		executeOptions.profiler = profiler.get();
+		executeOptions.tracer = tracer.get();
+		executeOptions.restoreState = options.loadState != nullptr ? &initial : nullptr;
+		executeOptions.saveState = options.saveState != nullptr ? &saved : nullptr;
+		executeOptions.rewindInterval = options.rewindInterval;
+		executeOptions.rewindDepth = options.rewindDepth;
+		executeOptions.recorder = options.record != nullptr ? &recorder : nullptr;
+		executeOptions.replay = options.replay != nullptr ? &replay : nullptr;
+		
+		// Генератор инициализируется так же, как при записи
+		if (replay.seeded) {
+			executeOptions.seeded = true;
+			executeOptions.seed = replay.seed;
+			executeOptions.random = replay.random;
+		}
 		
-		int res = translate(filename, code);
-		if (res != EXIT_SUCCESS) return res;
+		if (!options.headless) {
+			res = executeCode(image.code, executeOptions);
+			return writeResults(res, options, profiler.get(), tracer.get(), saved, debug);
+		}
 		
-		return executeCode(code);
+		FILE* out = stdout;
+		
+		if (options.output != nullptr) {
+			out = fopen(options.output, "w");
+			
+			if (out == nullptr) {
+				return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.output);
+			}
+		}
+		
+		res = executeCodeHeadless(image.code, out, executeOptions);
+		
+		if (out != stdout) {
+			fclose(out);
+		}
+		
+		return writeResults(res, options, profiler.get(), tracer.get(), saved, debug);
+	}
+	
+	
+	// Разбирает адрес: "$0801" и "0x0801" - шестнадцатеричный, "2049" - десятичный.
+	// Возвращает false, если строка не является адресом от 0 до $FFFF
+	static bool parseAddress(const char* str, uint16_t& addr) {
+		int base = 10;
+		
+		if (str[0] == '$') {
+			str += 1;
+			base = 16;
+			
+		} else if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+			str += 2;
+			base = 16;
+		}
+		
+		char* end;
+		unsigned long value = strtoul(str, &end, base);
+		if (*end != '\0' || end == str || !isxdigit(uint8_t(str[0])) || value > 0xFFFF) return false;
+		
+		addr = uint16_t(value);
+		return true;
+	}
+	
+	
+	// Разбирает аргументы командной строки. Возвращает 0 в случае успеха, иначе код ошибки.
+	int parseOptions(int argc, const char* args[], Options& options) {
+		for (int i = 1; i < argc; i++) {
+			const char* arg = args[i];
+			
+			if (strcmp(arg, "--headless") == 0) {
+				options.headless = true;
+				
+			} else if (strcmp(arg, "--stats") == 0) {
+				options.stats = true;
+				
+			} else if (strcmp(arg, "--jit") == 0) {
+				options.jit = true;
+				
+			} else if (strcmp(arg, "--no-fusion") == 0) {
+				options.fusion = false;
+				
+			} else if (strcmp(arg, "--no-cache") == 0) {
+				options.cache = CacheMode::DISABLED;
+				
+			} else if (strcmp(arg, "--rebuild") == 0) {
+				options.cache = CacheMode::REBUILD;
+				
+			} else if (strcmp(arg, "--format") == 0) {
+				if (++i == argc || !parseImageFormat(args[i], options.format)) return ARGUMENTS_ERROR;
+				options.formatSet = true;
+				
+			} else if (strcmp(arg, "--load-address") == 0) {
+				if (++i == argc || !parseAddress(args[i], options.loadAddress)) return ARGUMENTS_ERROR;
+				options.loadAddressSet = true;
+				
+			} else if (strcmp(arg, "--entry") == 0) {
+				if (++i == argc || !parseAddress(args[i], options.entry)) return ARGUMENTS_ERROR;
+				options.entrySet = true;
+				
+			} else if (strcmp(arg, "--clock") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				options.clock = strtoull(args[i], &end, 10);
+				if (*end != '\0' || options.clock == 0) return ARGUMENTS_ERROR;
+				
+			} else if (strcmp(arg, "--fps") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				unsigned long fps = strtoul(args[i], &end, 10);
+				if (*end != '\0' || fps == 0 || fps > 1000) return ARGUMENTS_ERROR;
+				options.maxFps = unsigned(fps);
+				
+			} else if (strcmp(arg, "--seed") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				options.seed = strtoull(args[i], &end, 10);
+				if (*end != '\0' || end == args[i]) return ARGUMENTS_ERROR;
+				options.seeded = true;
+				
+			} else if (strcmp(arg, "--rng") == 0) {
+				if (++i == argc || !parseRandomKind(args[i], options.random)) return ARGUMENTS_ERROR;
+				
+			} else if (strcmp(arg, "--profile") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.profile = args[i];
+				
+			} else if (strcmp(arg, "--flamegraph") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.flamegraph = args[i];
+				
+			} else if (strcmp(arg, "--trace") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.trace = args[i];
+				
+			} else if (strcmp(arg, "--trace-size") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				unsigned long long size = strtoull(args[i], &end, 10);
+				if (*end != '\0' || size == 0 || size > (1ULL << 28)) return ARGUMENTS_ERROR;
+				options.traceSize = size_t(size);
+				
+			} else if (strcmp(arg, "--load-state") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.loadState = args[i];
+				
+			} else if (strcmp(arg, "--save-state") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.saveState = args[i];
+				
+			} else if (strcmp(arg, "--rewind") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				options.rewindInterval = strtoull(args[i], &end, 10);
+				if (*end != '\0' || options.rewindInterval == 0) return ARGUMENTS_ERROR;
+				
+			} else if (strcmp(arg, "--rewind-depth") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				unsigned long long depth = strtoull(args[i], &end, 10);
+				if (*end != '\0' || depth == 0 || depth > 1000000) return ARGUMENTS_ERROR;
+				options.rewindDepth = size_t(depth);
+				
+			} else if (strcmp(arg, "--record") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.record = args[i];
+				
+			} else if (strcmp(arg, "--replay") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.replay = args[i];
+				
+			} else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.output = args[i];
+				
+			} else if (arg[0] == '-' || options.filename != nullptr) {
+				return ARGUMENTS_ERROR;
+				
+			} else {
+				options.filename = arg;
+			}
+		}
+		
+		if (options.record != nullptr && options.replay != nullptr) {
+			return ARGUMENTS_ERROR;
+		}
+		
+		if (!options.formatSet && options.filename != nullptr) {
+			options.format = detectImageFormat(options.filename);
+		}
+		
+		// Адрес загрузки задаётся только для образа без заголовка
+		if (options.loadAddressSet && options.format != ImageFormat::RAW) {
+			return ARGUMENTS_ERROR;
+		}
+		
+		return options.filename != nullptr || options.loadState != nullptr ? EXIT_SUCCESS : ARGUMENTS_ERROR;
 	}
 }
 
@@ -36,9 +381,23 @@ void on_signal(int signum) {
 
 int main(int argc, const char* args[]) {
 	using namespace int6502;
-
-	if (argc != 2) {
-		return error(ARGUMENTS_ERROR, "Usage: %s <file>", args[0]);
+	
+	Options options;
+	
+	if (parseOptions(argc, args, options) != EXIT_SUCCESS) {
+		return error(ARGUMENTS_ERROR, "Usage: %s [--headless] [--stats] [--jit] [--no-fusion] [--no-cache | --rebuild] "
+				"[--format source|raw|prg|hex] [--load-address <addr>] [--entry <addr>] [--clock <hz>] [--fps <n>] "
+				"[--seed <n>] [--rng xorshift|pcg] [--profile <report>] [--flamegraph <output>] "
+				"[--trace <output>] [--trace-size <n>] [--load-state <state>] [--save-state <output>] "
+				"[--rewind <cycles>] [--rewind-depth <n>] [--record <output> | --replay <input>] [-o <output>] <file>", args[0]);
+	}
+	
+	if ((options.profile != nullptr || options.flamegraph != nullptr) && !Profiler::isSupported()) {
+		return error(ARGUMENTS_ERROR, "Profiling is not available: rebuild with -DINT6502_PROFILER=ON");
+	}
+	
+	if (options.headless) {
+		return run(options);
 	}
 	
 	std::atexit(end_ncurses);
@@ -51,12 +410,12 @@ int main(int argc, const char* args[]) {
 		end_ncurses();
 		return error(COLOR_NOT_SUPPORTED_ERROR, "Your terminal does not support colors");
 	}
-
+	
 	start_color();
 	curs_set(false);
 	noecho();
 	keypad(stdscr, true);
 	saveDefaultColors();
 	
-	return run(args[1]);
+	return run(options);
 }
@@ -0,0 +1,76 @@
+#include "mapped_file.h"
+#include "error_codes.h"
+#include "util.h"
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define HAVE_MMAP 1
+#else
+	#define HAVE_MMAP 0
+#endif
+
+namespace int6502 {
+	
+	MappedFile::~MappedFile() {
+		#if HAVE_MMAP
+			if (mapped) {
+				munmap(const_cast<uint8_t*>(data), size);
+			}
+		#endif
+	}
+	
+	
+	int MappedFile::open(const char* filename, bool quiet) {
+		#if HAVE_MMAP
+			const int fd = ::open(filename, O_RDONLY);
+			
+			if (fd < 0) {
+				return quiet ? OPEN_FILE_ERROR : error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+			}
+			
+			struct stat fileStat;
+			
+			if (fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0) {
+				void* const mem = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				close(fd);
+				
+				if (mem != MAP_FAILED) {
+					// Файлы читаются от начала до конца
+					madvise(mem, size_t(fileStat.st_size), MADV_SEQUENTIAL);
+					
+					data = static_cast<const uint8_t*>(mem);
+					size = size_t(fileStat.st_size);
+					mapped = true;
+					return EXIT_SUCCESS;
+				}
+				
+			} else {
+				close(fd);
+			}
+		#endif
+		
+		FILE* file = fopen(filename, "rb");
+		
+		if (file == nullptr) {
+			return quiet ? OPEN_FILE_ERROR : error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		}
+		
+		uint8_t chunk[0x1000];
+		size_t count;
+		
+		while ((count = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+			buffer.insert(buffer.end(), chunk, chunk + count);
+		}
+		
+		fclose(file);
+		
+		data = buffer.data();
+		size = buffer.size();
+		return EXIT_SUCCESS;
+	}
+}
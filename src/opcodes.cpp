@@ -0,0 +1,43 @@
+#include "opcodes.h"
+
+namespace int6502 {
+	
+	static uint8_t getSize(Addressing mode) {
+		switch (mode) {
+			case Addressing::IMP:
+			case Addressing::ACC:
+				return 1;
+			
+			case Addressing::ABS:
+			case Addressing::ABS_X:
+			case Addressing::ABS_Y:
+			case Addressing::IND:
+				return 3;
+			
+			default:
+				return 2;
+		}
+	}
+	
+	
+	static OpcodeInfo OPCODE_INFO[0x100] = {};
+	
+	static bool initOpcodeInfo() {
+		#define INIT_OPCODE(opcode, mnemonic, mode, cycles) \
+			OPCODE_INFO[opcode] = { mnemonic, Addressing::mode, getSize(Addressing::mode), cycles };
+		
+		INT6502_OPCODES(INIT_OPCODE)
+		
+		#undef INIT_OPCODE
+		
+		return true;
+	}
+	
+	
+	const OpcodeInfo& getOpcodeInfo(uint8_t opcode) {
+		static bool unused = initOpcodeInfo();
+		(void)unused;
+		
+		return OPCODE_INFO[opcode];
+	}
+}
@@ -0,0 +1,230 @@
+#include "profiler.h"
+#include "opcodes.h"
+#include "insn.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace int6502 {
+	using std::string;
+	using std::vector;
+	
+	
+	Profiler::Profiler(): pcs(MEM_SIZE) {
+		frames.push_back(Frame { CODE_POS, 0, 0 });
+	}
+	
+	bool Profiler::isSupported() {
+	#ifdef INT6502_PROFILER
+		return true;
+	#else
+		return false;
+	#endif
+	}
+	
+	
+	void Profiler::account(uint16_t nextPc, uint64_t cycles) {
+		const uint64_t spent = cycles - lastCycles;
+		const OpcodeInfo& info = getOpcodeInfo(lastOpcode);
+		
+		opcodes[lastOpcode].count += 1;
+		opcodes[lastOpcode].cycles += spent;
+		
+		PcCounter& counter = pcs[lastPc];
+		counter.opcode = lastOpcode;
+		counter.count += 1;
+		counter.cycles += spent;
+		
+		frames[frame].cycles += spent;
+		
+		if (info.mode == Addressing::REL) {
+			// Переход выполнен, если следующая инструкция не идёт сразу за ним
+			if (nextPc != uint16_t(lastPc + info.size)) {
+				counter.taken += 1;
+			}
+			
+		} else if (lastOpcode == JSR) {
+			if (callStack.size() < MAX_DEPTH) {
+				const uint64_t key = uint64_t(frame) << 16 | nextPc;
+				auto found = children.find(key);
+				
+				if (found == children.end()) {
+					found = children.emplace(key, uint32_t(frames.size())).first;
+					frames.push_back(Frame { nextPc, frame, 0 });
+				}
+				
+				callStack.push_back(frame);
+				frame = found->second;
+				
+			} else {
+				skippedCalls++;
+			}
+			
+		} else if (lastOpcode == RTS) {
+			// Возврат из вызова, который не попал в стек, не должен снимать с него настоящий кадр
+			if (skippedCalls != 0) {
+				skippedCalls--;
+				
+			} else if (!callStack.empty()) {
+				frame = callStack.back();
+				callStack.pop_back();
+			}
+		}
+	}
+	
+	
+	// Режимы адресации в том же виде, что и в описаниях суперинструкций
+	static const char* getModeName(Addressing mode) {
+		switch (mode) {
+			case Addressing::IMP:   return "";
+			case Addressing::ACC:   return " a";
+			case Addressing::IMM:   return " #imm";
+			case Addressing::ZP:    return " zp";
+			case Addressing::ZP_X:  return " zp,x";
+			case Addressing::ZP_Y:  return " zp,y";
+			case Addressing::ABS:   return " abs";
+			case Addressing::ABS_X: return " abs,x";
+			case Addressing::ABS_Y: return " abs,y";
+			case Addressing::IND:   return " (abs)";
+			case Addressing::IND_X: return " (zp,x)";
+			case Addressing::IND_Y: return " (zp),y";
+			case Addressing::REL:   return "";
+		}
+		
+		return "";
+	}
+	
+	static string describeOpcode(uint8_t opcode) {
+		const OpcodeInfo& info = getOpcodeInfo(opcode);
+		
+		if (info.mnemonic == nullptr) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "$%02X", opcode);
+			return buffer;
+		}
+		
+		return string(info.mnemonic) + getModeName(info.mode);
+	}
+	
+	static string describeAddress(uint16_t addr, const DebugInfo* debug) {
+		if (debug != nullptr) {
+			return debug->getSymbol(addr);
+		}
+		
+		char buffer[8];
+		snprintf(buffer, sizeof(buffer), "$%04X", addr);
+		return buffer;
+	}
+	
+	static double percent(uint64_t value, uint64_t total) {
+		return total != 0 ? 100.0 * double(value) / double(total) : 0;
+	}
+	
+	
+	// Количество строк в списке самых горячих адресов
+	static const size_t HOT_SPOTS = 40;
+	
+	void Profiler::writeReport(FILE* out, const DebugInfo* debug) const {
+		uint64_t totalCount = 0, totalCycles = 0;
+		
+		for (const Counter& counter : opcodes) {
+			totalCount += counter.count;
+			totalCycles += counter.cycles;
+		}
+		
+		fprintf(out, "Executed %llu instructions, %llu cycles\n",
+				(unsigned long long)totalCount, (unsigned long long)totalCycles);
+		
+		
+		vector<uint16_t> order;
+		
+		for (uint16_t opcode = 0; opcode < 0x100; opcode++) {
+			if (opcodes[opcode].count != 0) order.push_back(opcode);
+		}
+		
+		std::stable_sort(order.begin(), order.end(), [this] (uint16_t a, uint16_t b) { return opcodes[a].cycles > opcodes[b].cycles; });
+		
+		fprintf(out, "\nOpcodes by cycles:\n");
+		fprintf(out, "  %-14s %14s %14s %8s\n", "opcode", "count", "cycles", "cycles%");
+		
+		for (uint16_t opcode : order) {
+			const Counter& counter = opcodes[opcode];
+			
+			fprintf(out, "  %-14s %14llu %14llu %7.2f%%\n", describeOpcode(uint8_t(opcode)).c_str(),
+					(unsigned long long)counter.count, (unsigned long long)counter.cycles, percent(counter.cycles, totalCycles));
+		}
+		
+		
+		vector<uint16_t> addrs, branches;
+		
+		for (size_t addr = 0; addr < pcs.size(); addr++) {
+			const PcCounter& counter = pcs[addr];
+			if (counter.count == 0) continue;
+			
+			addrs.push_back(uint16_t(addr));
+			
+			if (getOpcodeInfo(counter.opcode).mode == Addressing::REL) {
+				branches.push_back(uint16_t(addr));
+			}
+		}
+		
+		std::stable_sort(addrs.begin(), addrs.end(), [this] (uint16_t a, uint16_t b) { return pcs[a].cycles > pcs[b].cycles; });
+		std::stable_sort(branches.begin(), branches.end(), [this] (uint16_t a, uint16_t b) { return pcs[a].count > pcs[b].count; });
+		
+		if (addrs.size() > HOT_SPOTS) {
+			addrs.resize(HOT_SPOTS);
+		}
+		
+		
+		fprintf(out, "\nHot spots by cycles:\n");
+		fprintf(out, "  %-5s %5s  %-24s %-14s %14s %14s %8s\n", "addr", "line", "label", "instruction", "count", "cycles", "cycles%");
+		
+		for (uint16_t addr : addrs) {
+			const PcCounter& counter = pcs[addr];
+			
+			fprintf(out, "  $%04X %5d  %-24s %-14s %14llu %14llu %7.2f%%\n",
+					addr, debug != nullptr ? debug->getLine(addr) : 0, describeAddress(addr, debug).c_str(),
+					describeOpcode(counter.opcode).c_str(), (unsigned long long)counter.count,
+					(unsigned long long)counter.cycles, percent(counter.cycles, totalCycles));
+		}
+		
+		
+		fprintf(out, "\nBranches by executions:\n");
+		fprintf(out, "  %-5s %5s  %-24s %-14s %14s %14s %8s\n", "addr", "line", "label", "instruction", "taken", "not taken", "taken%");
+		
+		for (uint16_t addr : branches) {
+			const PcCounter& counter = pcs[addr];
+			
+			fprintf(out, "  $%04X %5d  %-24s %-14s %14llu %14llu %7.2f%%\n",
+					addr, debug != nullptr ? debug->getLine(addr) : 0, describeAddress(addr, debug).c_str(),
+					describeOpcode(counter.opcode).c_str(), (unsigned long long)counter.taken,
+					(unsigned long long)(counter.count - counter.taken), percent(counter.taken, counter.count));
+		}
+	}
+	
+	
+	string Profiler::getFramePath(uint32_t index, const DebugInfo* debug) const {
+		if (index == 0) {
+			return "main";
+		}
+		
+		const Frame& frame = frames[index];
+		return getFramePath(frame.parent, debug) + ';' + describeAddress(frame.entry, debug);
+	}
+	
+	void Profiler::writeFolded(FILE* out, const DebugInfo* debug) const {
+		vector<string> lines;
+		
+		for (uint32_t i = 0; i < frames.size(); i++) {
+			if (frames[i].cycles == 0) continue;
+			
+			lines.push_back(getFramePath(i, debug) + ' ' + std::to_string(frames[i].cycles));
+		}
+		
+		std::sort(lines.begin(), lines.end());
+		
+		for (const string& line : lines) {
+			fprintf(out, "%s\n", line.c_str());
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#include "random.h"
+#include <cstring>
+
+namespace int6502 {
+	
+	bool parseRandomKind(const char* name, RandomKind& kind) {
+		#define PARSE_RANDOM_KIND(kindName, option) \
+			if (strcmp(name, option) == 0) { kind = RandomKind::kindName; return true; }
+		
+		INT6502_RANDOM_KINDS(PARSE_RANDOM_KIND)
+		
+		#undef PARSE_RANDOM_KIND
+		
+		return false;
+	}
+	
+	
+	// splitmix64: близкие начальные значения дают несвязанные состояния
+	static uint64_t mix(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+	
+	void Random::seed(uint64_t seed, RandomKind kind) {
+		this->kind = kind;
+		state = mix(seed);
+		
+		// Нулевое состояние xorshift никогда не меняется
+		if (state == 0) {
+			state = 1;
+		}
+	}
+}
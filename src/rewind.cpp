@@ -0,0 +1,45 @@
+#include "rewind.h"
+#include "machine.h"
+#include <algorithm>
+
+namespace int6502 {
+	
+	RewindBuffer::RewindBuffer(uint64_t interval, size_t depth):
+			interval(std::max<uint64_t>(interval, 1)), depth(std::max<size_t>(depth, 1)) {}
+	
+	
+	void RewindBuffer::record(const Machine& machine) {
+		const uint64_t cycles = machine.getState().cycles;
+		
+		if (!history.empty() && cycles < nextCycles) {
+			return;
+		}
+		
+		history.push_back(machine.snapshot(history.empty() ? nullptr : &history.back()));
+		nextCycles = cycles + interval;
+		
+		if (history.size() > depth) {
+			history.pop_front();
+		}
+	}
+	
+	bool RewindBuffer::stepBack(Machine& machine) {
+		if (history.empty()) {
+			return false;
+		}
+		
+		// Снимок текущего состояния (сделанный сразу после последнего шага) пропускается
+		if (history.size() > 1 && history.back().getState().cycles == machine.getState().cycles) {
+			history.pop_back();
+		}
+		
+		machine.restore(history.back());
+		
+		if (history.size() > 1) {
+			history.pop_back();
+		}
+		
+		nextCycles = machine.getState().cycles + interval;
+		return true;
+	}
+}
@@ -1,6 +1,5 @@
 #include "scroll.h"
 #include "drawer.h"
-#include <vector>
 #include <ncurses.h>
 
 namespace int6502 {
@@ -9,15 +8,12 @@ namespace int6502 {
 	
 	using std::string;
 	
-	std::vector<string> lines;
-	size_t index = 0;
 	
-	
-	void addLine(const char* line) {
+	void Page::addLine(const char* line) {
 		lines.push_back(line);
 	}
 	
-	void addLine(string&& line) {
+	void Page::addLine(string&& line) {
 		lines.push_back(line);
 	}
 	
@@ -28,7 +24,7 @@ namespace int6502 {
 	
 	
 	
-	void dump(const char* header, uint8_t* mem, size_t offset, size_t lineSize, size_t lines) {
+	void Page::dump(const char* header, const uint8_t* mem, size_t offset, size_t lineSize, size_t lines) {
 		addLine("");
 		addLine(header);
 				
@@ -70,7 +66,7 @@ namespace int6502 {
 	}
 	
 	
-	void printLines() {
+	void Page::printLines() {
 		{
 			static bool unused = initEmptyLine();
 			(void)unused;
@@ -92,16 +88,25 @@ namespace int6502 {
 		refresh();
 	}
 	
+	void Page::writeLines(FILE* file) {
+		for (const string& line : lines) {
+			fputs(line.c_str(), file);
+			fputc('\n', file);
+		}
+		
+		fflush(file);
+	}
+	
 	uint64_t zeroIfNegative(uint64_t value) {
 		return uint64_t(std::max(int64_t(value), int64_t(0)));
 	}
 	
-	void scrollUp() {
+	void Page::scrollUp() {
 		index = zeroIfNegative(index - 1);
 		printLines();
 	}
 	
-	void scrollDown() {
+	void Page::scrollDown() {
 		uint64_t limit = zeroIfNegative(lines.size() - LINES + 1);
 		index = std::min(index + 1, limit);
 		printLines();
@@ -0,0 +1,213 @@
+#include "snapshot.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace int6502 {
+	
+	using std::vector;
+	using Page = Snapshot::Page;
+	
+	
+	static const char SNAPSHOT_MAGIC[8] = { 'I', '6', '5', '0', '2', 'S', 'N', 'P' };
+	static const uint32_t SNAPSHOT_VERSION = 1;
+	
+	#define COUNT_RANDOM_KIND(name, option) + 1
+	static const unsigned RANDOM_KIND_COUNT = 0 INT6502_RANDOM_KINDS(COUNT_RANDOM_KIND);
+	#undef COUNT_RANDOM_KIND
+	
+	
+	// Общая для всех снимков нулевая страница
+	static const std::shared_ptr<const Page>& getZeroPage() {
+		static const std::shared_ptr<const Page> zeroPage = std::make_shared<Page>(Page());
+		return zeroPage;
+	}
+	
+	static bool isZero(const uint8_t* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			if (data[i] != 0) return false;
+		}
+		
+		return true;
+	}
+	
+	
+	Snapshot::Snapshot(): state(initialState()) {
+		std::fill(std::begin(pages), std::end(pages), getZeroPage());
+	}
+	
+	Snapshot::Snapshot(const uint8_t* mem, const processor_state& state, const Snapshot* base): state(state) {
+		for (size_t i = 0; i < PAGES; i++) {
+			const uint8_t* data = mem + i * PAGE_SIZE;
+			
+			if (base != nullptr && memcmp(base->pages[i]->data(), data, PAGE_SIZE) == 0) {
+				pages[i] = base->pages[i];
+				
+			} else if (isZero(data, PAGE_SIZE)) {
+				pages[i] = getZeroPage();
+				
+			} else {
+				std::shared_ptr<Page> page = std::make_shared<Page>();
+				memcpy(page->data(), data, PAGE_SIZE);
+				pages[i] = std::move(page);
+			}
+		}
+	}
+	
+	
+	void Snapshot::copyMemory(uint8_t* mem) const {
+		for (size_t i = 0; i < PAGES; i++) {
+			memcpy(mem + i * PAGE_SIZE, pages[i]->data(), PAGE_SIZE);
+		}
+	}
+	
+	
+	// Числа в файле записываются в little-endian независимо от машины
+	static void put(vector<uint8_t>& out, uint64_t value, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			out.push_back(uint8_t(value >> (i * 8)));
+		}
+	}
+	
+	static uint64_t get(const uint8_t*& in, size_t size) {
+		uint64_t value = 0;
+		
+		for (size_t i = 0; i < size; i++) {
+			value |= uint64_t(*in++) << (i * 8);
+		}
+		
+		return value;
+	}
+	
+	
+	// Формат файла: заголовок, состояние процессора, битовая маска ненулевых страниц и сами эти страницы
+	static const size_t
+			HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + 4,
+			STATE_SIZE  = 5 + 2 + 1 + 8 + 8 + 8,
+			MASK_SIZE   = Snapshot::PAGES / 8;
+	
+	int Snapshot::save(const char* filename) const {
+		vector<uint8_t> data(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC));
+		put(data, SNAPSHOT_VERSION, 4);
+		
+		put(data, state.a, 1);
+		put(data, state.x, 1);
+		put(data, state.y, 1);
+		put(data, state.sp, 1);
+		put(data, state.flags, 1);
+		put(data, state.pc, 2);
+		put(data, uint8_t(state.random.kind), 1);
+		put(data, state.random.state, 8);
+		put(data, state.insns, 8);
+		put(data, state.cycles, 8);
+		
+		const size_t mask = data.size();
+		data.resize(mask + MASK_SIZE, 0);
+		
+		for (size_t i = 0; i < PAGES; i++) {
+			if (pages[i] != getZeroPage() && !isZero(pages[i]->data(), PAGE_SIZE)) {
+				data[mask + i / 8] |= uint8_t(1 << (i % 8));
+				data.insert(data.end(), pages[i]->begin(), pages[i]->end());
+			}
+		}
+		
+		FILE* file = fopen(filename, "wb");
+		if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+		ok = fclose(file) == 0 && ok;
+		
+		return ok ? EXIT_SUCCESS : error(OPEN_FILE_ERROR, "Cannot write file \"%s\"", filename);
+	}
+	
+	
+	int Snapshot::load(const char* filename) {
+		FILE* file = fopen(filename, "rb");
+		if (file == nullptr) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		vector<uint8_t> data;
+		uint8_t buffer[0x1000];
+		size_t count;
+		
+		while ((count = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+			data.insert(data.end(), buffer, buffer + count);
+		}
+		
+		fclose(file);
+		
+		if (data.size() < HEADER_SIZE || memcmp(data.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+			return error(INVALID_SYNTAX_ERROR, "\"%s\" is not a snapshot file", filename);
+		}
+		
+		const uint8_t* in = data.data() + sizeof(SNAPSHOT_MAGIC);
+		const uint32_t version = uint32_t(get(in, 4));
+		
+		if (version != SNAPSHOT_VERSION) {
+			return error(INVALID_SYNTAX_ERROR, "Unsupported snapshot version %u", version);
+		}
+		
+		if (data.size() < HEADER_SIZE + STATE_SIZE + MASK_SIZE) {
+			return error(INVALID_SYNTAX_ERROR, "Snapshot file \"%s\" is truncated", filename);
+		}
+		
+		processor_state loaded;
+		loaded.a = uint8_t(get(in, 1));
+		loaded.x = uint8_t(get(in, 1));
+		loaded.y = uint8_t(get(in, 1));
+		loaded.sp = uint8_t(get(in, 1));
+		loaded.flags = uint8_t(get(in, 1));
+		loaded.pc = uint16_t(get(in, 2));
+		loaded.random.kind = RandomKind(get(in, 1));
+		loaded.random.state = get(in, 8);
+		loaded.insns = get(in, 8);
+		loaded.cycles = get(in, 8);
+		
+		if (uint8_t(loaded.random.kind) >= RANDOM_KIND_COUNT) {
+			return error(INVALID_SYNTAX_ERROR, "Unknown random generator in snapshot \"%s\"", filename);
+		}
+		
+		const uint8_t* mask = in;
+		in += MASK_SIZE;
+		
+		std::shared_ptr<const Page> loadedPages[PAGES];
+		
+		for (size_t i = 0; i < PAGES; i++) {
+			if ((mask[i / 8] & (1 << (i % 8))) == 0) {
+				loadedPages[i] = getZeroPage();
+				continue;
+			}
+			
+			if (size_t(data.data() + data.size() - in) < PAGE_SIZE) {
+				return error(INVALID_SYNTAX_ERROR, "Snapshot file \"%s\" is truncated", filename);
+			}
+			
+			std::shared_ptr<Page> page = std::make_shared<Page>();
+			memcpy(page->data(), in, PAGE_SIZE);
+			in += PAGE_SIZE;
+			loadedPages[i] = std::move(page);
+		}
+		
+		// Снимок меняется, только если файл прочитан целиком
+		state = loaded;
+		std::move(std::begin(loadedPages), std::end(loadedPages), std::begin(pages));
+		return EXIT_SUCCESS;
+	}
+	
+	
+	bool Snapshot::isSnapshotFile(const char* filename) {
+		FILE* file = fopen(filename, "rb");
+		if (file == nullptr) return false;
+		
+		char magic[sizeof(SNAPSHOT_MAGIC)];
+		const bool res = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+				memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+		
+		fclose(file);
+		return res;
+	}
+}
@@ -0,0 +1,93 @@
+#include "symbols.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <cstring>
+
+namespace int6502 {
+	
+	static const size_t
+			INITIAL_SLOTS = 0x400,
+			CHUNK_SIZE    = 0x4000; // Размер блока арены для строк
+	
+	
+	// FNV-1a, 32 бита
+	static uint32_t hashString(const char* str, size_t length) {
+		uint32_t hash = 0x811C9DC5;
+		
+		for (size_t i = 0; i < length; i++) {
+			hash = (hash ^ uint8_t(str[i])) * 0x01000193;
+		}
+		
+		return hash;
+	}
+	
+	
+	SymbolTable::SymbolTable(): slots(INITIAL_SLOTS, 0) {}
+	
+	
+	const char* SymbolTable::store(const char* str, size_t length) {
+		if (length + 1 > chunkLeft) {
+			const size_t size = std::max(CHUNK_SIZE, length + 1);
+			
+			chunks.emplace_back(new char[size]);
+			chunkPos = chunks.back().get();
+			chunkLeft = size;
+		}
+		
+		char* const res = chunkPos;
+		memcpy(res, str, length);
+		res[length] = '\0';
+		
+		chunkPos += length + 1;
+		chunkLeft -= length + 1;
+		return res;
+	}
+	
+	
+	void SymbolTable::grow() {
+		std::vector<Symbol> newSlots(slots.size() * 2, 0);
+		const size_t mask = newSlots.size() - 1;
+		
+		for (Symbol symbol = 0; symbol < entries.size(); symbol++) {
+			size_t i = entries[symbol].hash & mask;
+			
+			while (newSlots[i] != 0) {
+				i = (i + 1) & mask;
+			}
+			
+			newSlots[i] = symbol + 1;
+		}
+		
+		slots.swap(newSlots);
+	}
+	
+	
+	Symbol SymbolTable::intern(const char* str, size_t length) {
+		const uint32_t hash = hashString(str, length);
+		const size_t mask = slots.size() - 1;
+		
+		size_t i = hash & mask;
+		
+		for (; slots[i] != 0; i = (i + 1) & mask) {
+			const Entry& entry = entries[slots[i] - 1];
+			
+			if (entry.hash == hash && entry.length == length && memcmp(entry.name, str, length) == 0) {
+				return slots[i] - 1;
+			}
+		}
+		
+		const Symbol symbol = Symbol(entries.size());
+		const char* const name = store(str, length);
+		
+		entries.push_back(Entry { name, uint32_t(length), hash, symbol, NO_LABEL, isValidLabel(name, length) });
+		slots[i] = symbol + 1;
+		
+		// Таблица заполняется не больше чем наполовину, чтобы цепочки проб оставались короткими
+		if (entries.size() * 2 > slots.size()) {
+			grow();
+		}
+		
+		return symbol;
+	}
+}
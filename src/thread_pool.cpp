@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace int6502 {
+	
+	ThreadPool::ThreadPool(unsigned threadCount): queued(0), unfinished(0), nextQueue(0) {
+		if (threadCount == 0) {
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		
+		for (unsigned i = 0; i < threadCount; i++) {
+			queues.emplace_back(new Queue);
+		}
+		
+		for (unsigned i = 0; i < threadCount; i++) {
+			threads.emplace_back(&ThreadPool::work, this, i);
+		}
+	}
+	
+	ThreadPool::~ThreadPool() {
+		wait();
+		
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		
+		hasWork.notify_all();
+		
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+	
+	
+	void ThreadPool::submit(Task task) {
+		Queue& queue = *queues[nextQueue++ % queues.size()];
+		
+		unfinished++;
+		
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(std::move(task));
+			queued++;
+		}
+		
+		// Поток мог проверить queued, но ещё не заснуть: захват mutex дожидается, пока он заснёт
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		
+		hasWork.notify_one();
+	}
+	
+	
+	void ThreadPool::wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return unfinished == 0; });
+	}
+	
+	
+	// Берёт задачу из своей очереди, а если она пуста - из чужой.
+	// Свои задачи берутся по порядку добавления, чтобы результаты шли в порядке задач,
+	// а чужие - с конца, чтобы не забирать у владельца ближайшие задачи
+	bool ThreadPool::take(size_t index, Task& task) {
+		for (size_t i = 0; i < queues.size(); i++) {
+			Queue& queue = *queues[(index + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			
+			if (queue.tasks.empty()) continue;
+			
+			if (i == 0) {
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			} else {
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			
+			queued--;
+			return true;
+		}
+		
+		return false;
+	}
+	
+	
+	void ThreadPool::work(size_t index) {
+		for (;;) {
+			Task task;
+			
+			if (!take(index, task)) {
+				std::unique_lock<std::mutex> lock(mutex);
+				hasWork.wait(lock, [this] { return stopping || queued != 0; });
+				
+				if (stopping) return;
+				continue;
+			}
+			
+			task();
+			
+			if (--unfinished == 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				done.notify_all();
+			}
+		}
+	}
+}
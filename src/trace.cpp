@@ -0,0 +1,145 @@
+#include "trace.h"
+#include "opcodes.h"
+#include "error_codes.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace int6502 {
+	
+	using std::vector;
+	
+	
+	Tracer::Tracer(size_t capacity) {
+		size_t size = 1;
+		
+		while (size < capacity) {
+			size <<= 1;
+		}
+		
+		records.resize(size, TraceRecord());
+		mask = size - 1;
+	}
+	
+	
+	int Tracer::write(const char* filename) const {
+		FILE* file = fopen(filename, "wb");
+		if (file == NULL) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		TraceHeader header;
+		memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+		header.version = TRACE_VERSION;
+		header.recordSize = sizeof(TraceRecord);
+		header.count = std::min<uint64_t>(total, records.size());
+		header.total = total;
+		header.lastCycles = lastCycles;
+		
+		// Самая старая запись находится сразу после самой новой
+		const size_t first = size_t((total - header.count) & mask);
+		const size_t tail = std::min<size_t>(size_t(header.count), records.size() - first);
+		
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+				fwrite(&records[first], sizeof(TraceRecord), tail, file) == tail &&
+				fwrite(&records[0], sizeof(TraceRecord), size_t(header.count) - tail, file) == size_t(header.count) - tail;
+		
+		ok = fclose(file) == 0 && ok;
+		
+		return ok ? EXIT_SUCCESS : error(OPEN_FILE_ERROR, "Cannot write file \"%s\"", filename);
+	}
+	
+	
+	int readTrace(const char* filename, TraceHeader& header, vector<TraceRecord>& records, vector<uint64_t>& cycles) {
+		FILE* file = fopen(filename, "rb");
+		if (file == NULL) return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
+		
+		if (fread(&header, sizeof(header), 1, file) != 1 ||
+			memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+				
+			fclose(file);
+			return error(INVALID_SYNTAX_ERROR, "\"%s\" is not a trace file", filename);
+		}
+		
+		if (header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+			fclose(file);
+			return error(INVALID_SYNTAX_ERROR, "Unsupported trace version %u", header.version);
+		}
+		
+		records.resize(size_t(header.count));
+		const size_t count = fread(records.data(), sizeof(TraceRecord), records.size(), file);
+		fclose(file);
+		
+		if (count != records.size()) {
+			return error(INVALID_SYNTAX_ERROR, "Trace file \"%s\" is truncated", filename);
+		}
+		
+		// Разница тактов между соседними инструкциями меньше 2^32,
+		// поэтому полные значения восстанавливаются от последней записи назад
+		cycles.resize(records.size());
+		uint64_t current = header.lastCycles;
+		
+		for (size_t i = records.size(); i-- > 0; ) {
+			cycles[i] = current;
+			
+			if (i > 0) {
+				current -= uint32_t(records[i].cycles - records[i - 1].cycles);
+			}
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	
+	void writeTraceRecord(FILE* out, const TraceRecord& record, uint64_t cycles) {
+		const OpcodeInfo& info = getOpcodeInfo(record.opcode);
+		const uint8_t* o = record.operand;
+		const uint16_t word = uint16_t(o[0] | o[1] << 8);
+		
+		char bytes[16];
+		char text[24];
+		
+		switch (info.size) {
+			case 2:  snprintf(bytes, sizeof(bytes), "%02X %02X",      record.opcode, o[0]);       break;
+			case 3:  snprintf(bytes, sizeof(bytes), "%02X %02X %02X", record.opcode, o[0], o[1]); break;
+			default: snprintf(bytes, sizeof(bytes), "%02X",           record.opcode);             break;
+		}
+		
+		if (info.mnemonic == NULL) {
+			snprintf(text, sizeof(text), "??? $%02X", record.opcode);
+			
+		} else {
+			switch (info.mode) {
+				case Addressing::IMP:   snprintf(text, sizeof(text), "%s",            info.mnemonic);       break;
+				case Addressing::ACC:   snprintf(text, sizeof(text), "%s a",          info.mnemonic);       break;
+				case Addressing::IMM:   snprintf(text, sizeof(text), "%s #$%02X",     info.mnemonic, o[0]); break;
+				case Addressing::ZP:    snprintf(text, sizeof(text), "%s $%02X",      info.mnemonic, o[0]); break;
+				case Addressing::ZP_X:  snprintf(text, sizeof(text), "%s $%02X,x",    info.mnemonic, o[0]); break;
+				case Addressing::ZP_Y:  snprintf(text, sizeof(text), "%s $%02X,y",    info.mnemonic, o[0]); break;
+				case Addressing::ABS:   snprintf(text, sizeof(text), "%s $%04X",      info.mnemonic, word); break;
+				case Addressing::ABS_X: snprintf(text, sizeof(text), "%s $%04X,x",    info.mnemonic, word); break;
+				case Addressing::ABS_Y: snprintf(text, sizeof(text), "%s $%04X,y",    info.mnemonic, word); break;
+				case Addressing::IND:   snprintf(text, sizeof(text), "%s ($%04X)",    info.mnemonic, word); break;
+				case Addressing::IND_X: snprintf(text, sizeof(text), "%s ($%02X,x)",  info.mnemonic, o[0]); break;
+				case Addressing::IND_Y: snprintf(text, sizeof(text), "%s ($%02X),y",  info.mnemonic, o[0]); break;
+				case Addressing::REL:
+					snprintf(text, sizeof(text), "%s $%04X", info.mnemonic, uint16_t(record.pc + 2 + int8_t(o[0])));
+					break;
+			}
+		}
+		
+		// Установленные флаги - заглавными буквами
+		const char* names = "NV-BDIZC";
+		char flags[9];
+		
+		for (int i = 0; i < 8; i++) {
+			const bool set = (record.flags >> (7 - i)) & 1;
+			flags[i] = set || names[i] == '-' ? names[i] : char(names[i] - 'A' + 'a');
+		}
+		
+		flags[8] = '\0';
+		
+		fprintf(out, "%12llu  $%04X  %-8s  %-14s  A:%02X X:%02X Y:%02X SP:%02X P:%s\n",
+				(unsigned long long)cycles, record.pc, bytes, text,
+				record.a, record.x, record.y, record.sp, flags);
+	}
+}
@@ -0,0 +1,117 @@
+#include "trace.h"
+#include "translator.h"
+#include "error_codes.h"
+#include "util.h"
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace int6502 {
+	using std::vector;
+	
+	
+	struct Options {
+		const char* filename = nullptr;
+		const char* source = nullptr; // Исходник программы для вывода лейблов
+		const char* output = nullptr; // NULL - stdout
+		uint64_t last = 0;            // 0 - все записи
+	};
+	
+	
+	int run(const Options& options) {
+		TraceHeader header;
+		vector<TraceRecord> records;
+		vector<uint64_t> cycles;
+		
+		int res = readTrace(options.filename, header, records, cycles);
+		if (res != EXIT_SUCCESS) return res;
+		
+		DebugInfo debug;
+		
+		if (options.source != nullptr) {
+			vector<uint8_t> code;
+			res = translate(options.source, code, &debug);
+			if (res != EXIT_SUCCESS) return res;
+		}
+		
+		FILE* out = stdout;
+		
+		if (options.output != nullptr) {
+			out = fopen(options.output, "w");
+			
+			if (out == nullptr) {
+				return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", options.output);
+			}
+		}
+		
+		size_t first = 0;
+		
+		if (options.last != 0 && options.last < records.size()) {
+			first = records.size() - size_t(options.last);
+		}
+		
+		fprintf(out, "; %zu of %llu instructions\n", records.size() - first, (unsigned long long)header.total);
+		fprintf(out, ";       cycle  pc     bytes     instruction     registers\n");
+		
+		for (size_t i = first; i < records.size(); i++) {
+			const auto label = debug.labels.find(records[i].pc);
+			
+			if (label != debug.labels.end()) {
+				fprintf(out, "%s:\n", label->second.c_str());
+			}
+			
+			writeTraceRecord(out, records[i], cycles[i]);
+		}
+		
+		if (out != stdout) {
+			fclose(out);
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
+	
+	// Разбирает аргументы командной строки. Возвращает 0 в случае успеха, иначе код ошибки.
+	int parseOptions(int argc, const char* args[], Options& options) {
+		for (int i = 1; i < argc; i++) {
+			const char* arg = args[i];
+			
+			if (strcmp(arg, "--last") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				
+				char* end;
+				options.last = strtoull(args[i], &end, 10);
+				if (*end != '\0' || options.last == 0) return ARGUMENTS_ERROR;
+				
+			} else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--source") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.source = args[i];
+				
+			} else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+				if (++i == argc) return ARGUMENTS_ERROR;
+				options.output = args[i];
+				
+			} else if (arg[0] == '-' || options.filename != nullptr) {
+				return ARGUMENTS_ERROR;
+				
+			} else {
+				options.filename = arg;
+			}
+		}
+		
+		return options.filename != nullptr ? EXIT_SUCCESS : ARGUMENTS_ERROR;
+	}
+}
+
+
+int main(int argc, const char* args[]) {
+	using namespace int6502;
+	
+	Options options;
+	
+	if (parseOptions(argc, args, options) != EXIT_SUCCESS) {
+		return error(ARGUMENTS_ERROR, "Usage: %s [--last <n>] [-s <source>] [-o <output>] <trace>", args[0]);
+	}
+	
+	return run(options);
+}
@@ -2,8 +2,14 @@
 #include "error_codes.h"
 #include "util.h"
 #include "insn.h"
-#include <fstream>
+#include "mapped_file.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace int6502 {
@@ -12,82 +18,193 @@ namespace int6502 {
 	using std::map;
 	
 	
-	int processLine(string line, const map<string, InsnFunction>& insnTable,
-	                map<string, size_t>& labels, DefineTable& defineTable,
-	                int lineNum, vector<uint8_t>& code) {
+	// Таблица инструкций по упакованной в число мнемонике (см. packMnemonic)
+	using InsnLookup = std::unordered_map<uint64_t, InsnFunction>;
+	
+	
+	static inline bool isSpace(char c) {
+		return std::isspace(uint8_t(c));
+	}
+	
+	// Мнемоники и директивы не длиннее 8 символов, поэтому ищутся по числу из их байтов в нижнем регистре.
+	// Возвращает 0 для более длинных строк
+	static uint64_t packMnemonic(const char* str, size_t length) {
+		if (length > sizeof(uint64_t)) return 0;
+		
+		uint64_t key = 0;
+		
+		for (size_t i = 0; i < length; i++) {
+			key = key << 8 | uint8_t(std::tolower(uint8_t(str[i])));
+		}
 		
-		size_t index = line.find(';');
+		return key;
+	}
+	
+	static InsnLookup createInsnLookup() {
+		InsnLookup lookup;
+		
+		for (auto& insn : createInsnTable()) {
+			lookup.emplace(packMnemonic(insn.first.data(), insn.first.size()), std::move(insn.second));
+		}
+		
+		return lookup;
+	}
+	
+	
+	// Строка line длины length разбирается по индексам без промежуточных копий, чтобы знать столбцы для сообщений об ошибках.
+	// Мнемоника и операнд копируются в operation и operand, которые переиспользуются между строками,
+	// поэтому память под них выделяется только при появлении более длинной строки
+	int processLine(const char* line, size_t length, const InsnLookup& insnTable,
+	                AssemblerState& state, int lineNum, vector<uint8_t>& code, string& operation, string& operand) {
 		
-		if (index != string::npos)
-			line = line.substr(0, index);
+		const char* const comment = static_cast<const char*>(memchr(line, ';', length));
+		const char* const colonPtr = static_cast<const char*>(memchr(line, ':', length));
 		
+		size_t end = comment != nullptr ? size_t(comment - line) : length;
+		size_t begin = 0;
 		
-		index = line.find(':');
+		const size_t colon = colonPtr != nullptr ? size_t(colonPtr - line) : length;
 		
-		if (index != string::npos) {
-			string label = line.substr(0, index);
-			line = line.substr(index + 1);
+		if (colon < end) {
+			while (begin < colon && isSpace(line[begin])) begin++;
 			
-			trim(label);
+			size_t labelEnd = colon;
+			while (labelEnd > begin && isSpace(line[labelEnd - 1])) labelEnd--;
 			
-			if (!std::all_of(label.cbegin(), label.cend(), [] (char c) { return std::isalpha(c) || std::isdigit(c) || c == '_'; })) {
-				return invalidSyntaxError(lineNum);
+			for (size_t i = begin; i < labelEnd; i++) {
+				const char c = line[i];
+				
+				if (!std::isalpha(uint8_t(c)) && !std::isdigit(uint8_t(c)) && c != '_') {
+					return syntaxErrorAt(lineNum, int(i) + 1, "Invalid character in label name");
+				}
 			}
 			
-			labels[std::move(label)] = code.size();
+			SymbolTable& symbols = state.symbols;
+			symbols.setLabel(symbols.intern(line + begin, labelEnd - begin), code.size());
+			begin = colon + 1;
 		}
 		
-		trim(line);
+		while (begin < end && isSpace(line[begin])) begin++;
+		while (end > begin && isSpace(line[end - 1])) end--;
 		
+		if (begin == end)
+			return EXIT_SUCCESS;
 		
-		string operation, operand;
-		
-		index = line.find_first_of(" \v\f\t\r");
+		size_t operationEnd = begin;
+		while (operationEnd < end && !isSpace(line[operationEnd])) operationEnd++;
 		
-		if (index != string::npos) {
-			operation = line.substr(0, index);
-			operand = line.substr(index);
-			ltrim(operand);
-		} else {
-			operation = std::move(line);
-		}
+		size_t operandBegin = operationEnd;
+		while (operandBegin < end && isSpace(line[operandBegin])) operandBegin++;
 		
-		if (operation.empty() && operand.empty())
-			return EXIT_SUCCESS;
+		operation.assign(line + begin, operationEnd - begin);
+		operand.assign(line + operandBegin, end - operandBegin);
 		
 		tolower(operation);
+		state.operandColumn = int(operandBegin) + 1;
 		
 		
-		auto found = insnTable.find(operation);
+		auto found = insnTable.find(packMnemonic(operation.data(), operation.size()));
 		
 		if (found == insnTable.end()) {
-			return syntaxError(lineNum, "Unknown instruction \"%s\"", operation.c_str());
+			return syntaxErrorAt(lineNum, int(begin) + 1, "Unknown instruction \"%s\"", operation.c_str());
 		}
 		
-		return found->second(operation, operand, defineTable, lineNum, code);
+		return found->second(operation, operand, state, lineNum, code);
 	}
 	
 	
-	int translate(const char* filename, vector<uint8_t>& code) {
-		std::ifstream file(filename);
+	int translate(const char* source, size_t size, vector<uint8_t>& code, DebugInfo* debug) {
+		static const InsnLookup insnTable = createInsnLookup();
 		
-		if (!file.good()) {
-			return error(OPEN_FILE_ERROR, "Cannot open file \"%s\"", filename);
-		}
+		AssemblerState state;
+		string operation, operand;
+		int lineNum = 1;
 		
-		static const map<string, InsnFunction> insnTable = createInsnTable();
+		const char* const sourceEnd = source + size;
 		
-		map<string, size_t> labels;
-		DefineTable defineTable;
-		int lineNum = 1;
+		for (const char* line = source; line < sourceEnd; ++lineNum) {
+			const char* newline = static_cast<const char*>(memchr(line, '\n', size_t(sourceEnd - line)));
+			
+			if (newline == nullptr) {
+				newline = sourceEnd;
+			}
+			
+			const size_t length = size_t(newline - line);
+			
+			if (length != 0) {
+				const size_t start = code.size();
+				
+				int res = processLine(line, length, insnTable, state, lineNum, code, operation, operand);
+				if (res != EXIT_SUCCESS) return res;
+				
+				if (debug != nullptr && code.size() != start) {
+					debug->lines[uint16_t(CODE_POS + start)] = lineNum;
+				}
+			}
+			
+			line = newline + 1;
+		}
 		
-		for (string line; std::getline(file, line); ++lineNum) {
-			if (line.empty()) continue;
+		if (debug != nullptr) {
+			const SymbolTable& symbols = state.symbols;
 			
-			int res = processLine(line, insnTable, labels, defineTable, lineNum, code);
-			if (res != EXIT_SUCCESS) return res;
+			for (Symbol symbol = 0; symbol < symbols.size(); symbol++) {
+				const size_t offset = symbols.getLabel(symbol);
+				if (offset == SymbolTable::NO_LABEL) continue;
+				
+				// Из нескольких лейблов на один адрес остаётся первый по алфавиту
+				string& name = debug->labels[uint16_t(CODE_POS + offset)];
+				
+				if (name.empty() || name > symbols.getName(symbol)) {
+					name = symbols.getName(symbol);
+				}
+			}
+		}
+		
+		return initLabels(code, state);
+	}
+	
+	
+	int translate(std::istream& source, vector<uint8_t>& code, DebugInfo* debug) {
+		std::ostringstream text;
+		text << source.rdbuf();
+		
+		const string& str = text.str();
+		return translate(str.data(), str.size(), code, debug);
+	}
+	
+	
+	int DebugInfo::getLine(uint16_t addr) const {
+		auto found = lines.find(addr);
+		return found != lines.end() ? found->second : 0;
+	}
+	
+	string DebugInfo::getSymbol(uint16_t addr) const {
+		char buffer[16];
+		auto found = labels.upper_bound(addr);
+		
+		if (found == labels.begin()) {
+			snprintf(buffer, sizeof(buffer), "$%04X", addr);
+			return buffer;
 		}
 		
-		return initLabels(code, labels);
+		--found;
+		
+		if (found->first == addr) {
+			return found->second;
+		}
+		
+		snprintf(buffer, sizeof(buffer), "+%u", unsigned(addr - found->first));
+		return found->second + buffer;
+	}
+	
+	
+	int translate(const char* filename, vector<uint8_t>& code, DebugInfo* debug) {
+		MappedFile file;
+		
+		int res = file.open(filename);
+		if (res != EXIT_SUCCESS) return res;
+		
+		return translate(file.getChars(), file.getSize(), code, debug);
 	}
 }